@@ -18,8 +18,9 @@ fi
 
 cd "$WORK_DIR" || exit
 
-CONFIG_BLOCK_SZ=512
+CONFIG_BLOCK_SZ=${DDRIVER_BLOCK_SZ:-512}
 BLOCK_COUNT=8192
+KERNEL_DISK_SZ=${DDRIVER_KERNEL_DISK_SZ:-$((4 * 1024 * 1024))}  # 内核设备大小，须为页大小的整数倍
 
 
 function usage(){
@@ -44,6 +45,16 @@ function usage(){
     echo "===================================================================="
 }
 
+# 内核设备大小以已加载模块的参数为准
+function kernel_disk_size() {
+    cat /sys/module/ddriver/parameters/disk_sz 2>/dev/null || echo "$KERNEL_DISK_SZ"
+}
+
+# 用户态设备的几何参数可由DDRIVER_*环境变量配置，块数按实际文件大小计算
+function user_block_count() {
+    echo $(( $(stat -c %s "$USER_DEV_PATH") / CONFIG_BLOCK_SZ ))
+}
+
 function restore_bashrc() {
     cp "$HOME"/.bashrc_copy "$HOME"/.bashrc -f  
 }
@@ -80,7 +91,7 @@ function install() {
         sudo rm $KERNEL_DEV_PATH>/dev/null 2>&1 
         sudo rmmod ddriver>/dev/null 2>&1 
         sudo dmesg -C
-        sudo insmod ./ddriver.ko
+        sudo insmod ./ddriver.ko disk_sz="$KERNEL_DISK_SZ"
         in=$(dmesg | tail -n 1)
         tokens=("$in")
         major_number=${tokens[${#tokens[*]}-1]}
@@ -123,11 +134,11 @@ function install() {
 function test(){
     if [ "$DDRIVER_TYPE" == "k" ]; then   
         # test read
-        sudo dd if=$KERNEL_DEV_PATH of=read1 bs=$CONFIG_BLOCK_SZ count=$BLOCK_COUNT
+        sudo dd if=$KERNEL_DEV_PATH of=read1 bs=1M count=$(kernel_disk_size) iflag=count_bytes
         # test write
         sudo dd if=/dev/random of=$KERNEL_DEV_PATH bs=$CONFIG_BLOCK_SZ count=2
         # test read
-        sudo dd if=$KERNEL_DEV_PATH of=read2 bs=$CONFIG_BLOCK_SZ count=$BLOCK_COUNT
+        sudo dd if=$KERNEL_DEV_PATH of=read2 bs=1M count=$(kernel_disk_size) iflag=count_bytes
     else 
         exit
     fi
@@ -145,10 +156,10 @@ function dump(){
     sudo rm "$ORIGIN_WORK_DIR"/ddriver_dump>/dev/null 2>&1 
     if [ "$DDRIVER_TYPE" == "k" ]; then  
         echo "目标设备 $KERNEL_DEV_PATH"
-        sudo dd if=$KERNEL_DEV_PATH of="$ORIGIN_WORK_DIR"/ddriver_dump bs=$CONFIG_BLOCK_SZ count=$BLOCK_COUNT
+        sudo dd if=$KERNEL_DEV_PATH of="$ORIGIN_WORK_DIR"/ddriver_dump bs=1M count=$(kernel_disk_size) iflag=count_bytes
     else 
         echo "目标设备 $USER_DEV_PATH"
-        dd if="$USER_DEV_PATH" of="$ORIGIN_WORK_DIR"/ddriver_dump bs=$CONFIG_BLOCK_SZ count=$BLOCK_COUNT
+        dd if="$USER_DEV_PATH" of="$ORIGIN_WORK_DIR"/ddriver_dump bs=$CONFIG_BLOCK_SZ count=$(user_block_count)
     fi
     echo "文件已导出至$ORIGIN_WORK_DIR/ddriver_dump，请安装HexEditor插件查看其内容"
 }
@@ -156,10 +167,12 @@ function dump(){
 function clean(){
     if [ "$DDRIVER_TYPE" == "k" ]; then  
         echo "目标设备 $KERNEL_DEV_PATH"
-        sudo dd if=/dev/zero of=$KERNEL_DEV_PATH bs=$CONFIG_BLOCK_SZ count=$BLOCK_COUNT
+        sudo dd if=/dev/zero of=$KERNEL_DEV_PATH bs=1M count=$(kernel_disk_size) iflag=count_bytes
     else
         echo "目标设备 $USER_DEV_PATH"
-        dd if=/dev/zero of="$USER_DEV_PATH" bs=$CONFIG_BLOCK_SZ count=$BLOCK_COUNT
+        # 优先打洞，保持设备文件稀疏；文件系统不支持时退化为写0
+        fallocate -p -o 0 -l "$(stat -c %s "$USER_DEV_PATH")" "$USER_DEV_PATH" 2>/dev/null || \
+        dd if=/dev/zero of="$USER_DEV_PATH" bs=$CONFIG_BLOCK_SZ count=$(user_block_count) conv=notrunc
     fi 
 }
 
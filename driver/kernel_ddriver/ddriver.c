@@ -4,6 +4,12 @@
 #include <linux/fs.h>
 #include <asm/uaccess.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/atomic.h>
 #include "ddriver_ctl.h"
 /******************************************************************************
 * SECTION: Macro definitions
@@ -27,7 +33,7 @@
                         "filp_open/cpp-filp_open-function-examples.html>"
 #define DRIVER_VERSION  "0.1.0"
 
-#define CONFIG_DISK_SZ  (4 * 1024 * 1024)
+#define CONFIG_DISK_SZ  (4 * 1024 * 1024)             /* Default, overridden by disk_sz */
 #define CONFIG_BLOCK_SZ (512)
 /******************************************************************************
 * SECTION: Macro Functions 
@@ -36,14 +42,9 @@
 #define IS_ADDR_ALIGN(addr)     (addr % CONFIG_BLOCK_SZ == 0)
 #define ADDR_ROUND_UP(addr)     ((addr / CONFIG_BLOCK_SZ) * CONFIG_BLOCK_SZ)
 
-#define GET_HEAD_POS(disk)      (disk.head - disk.layout)
-#define FORWARD_HEAD(disk, dis) (disk.head += dis)
-#define SET_HEAD(disk, ofs)     (disk.head = disk.layout + ofs)
-#define RESET_HEAD(disk)        (SET_HEAD(disk, 0))
-
-#define INC_READCNT(disk)       (disk.read_cnt++)
-#define INC_WRITECNT(disk)      (disk.write_cnt++)
-#define INC_SEEKCNT(disk)       (disk.seek_cnt++)
+#define INC_READCNT(disk)       (atomic_inc(&disk.read_cnt))
+#define INC_WRITECNT(disk)      (atomic_inc(&disk.write_cnt))
+#define INC_SEEKCNT(disk)       (atomic_inc(&disk.seek_cnt))
 /******************************************************************************
 * SECTION: Kernel Module Template
 *******************************************************************************/
@@ -51,44 +52,50 @@ MODULE_LICENSE("GPL");
 MODULE_AUTHOR(DRIVER_AUTHOR);	    
 MODULE_DESCRIPTION(DRIVER_DESC);	
 MODULE_VERSION(DRIVER_VERSION);	
+
+static int disk_sz = CONFIG_DISK_SZ;
+module_param(disk_sz, int, 0444);
+MODULE_PARM_DESC(disk_sz, "Disk size in bytes, multiple of PAGE_SIZE (default 4MiB)");
 /******************************************************************************
 * SECTION: Type definitions
 *******************************************************************************/
 struct ddriver
 {
-    char layout[CONFIG_DISK_SZ];                      /* Disk Layout */
-    char *head;                                       /* Disk Head */
-    int  read_cnt;
-    int  write_cnt;
-    int  seek_cnt;
+    char *layout;                                     /* Disk Layout, vmalloc_user, mmap-able */
+                                                      /* Disk Head lives in each file's f_pos */
+    atomic_t read_cnt;
+    atomic_t write_cnt;
+    atomic_t seek_cnt;
     int  major_num;
     int  open_count;
     int  layout_size;
     int  iounit_size;
+    struct mutex lock;                                /* Protects open_count */
 };
 
 static struct ddriver disk = {
-    .head        = NULL,
-    .read_cnt    = 0,
-    .write_cnt   = 0,
-    .seek_cnt    = 0,
+    .layout      = NULL,
+    .read_cnt    = ATOMIC_INIT(0),
+    .write_cnt   = ATOMIC_INIT(0),
+    .seek_cnt    = ATOMIC_INIT(0),
     .major_num   = 0,
     .open_count  = 0,
     .layout_size = CONFIG_DISK_SZ,
-    .iounit_size = CONFIG_BLOCK_SZ
+    .iounit_size = CONFIG_BLOCK_SZ,
+    .lock        = __MUTEX_INITIALIZER(disk.lock)
 };
 /******************************************************************************
 * SECTION: Helper Functions
 *******************************************************************************/
-int check_valid(size_t size){
-    if (GET_HEAD_POS(disk) >=  CONFIG_DISK_SZ) {
-        kernel_alert("disk head reach the end");
-        return -EINVAL;
-    }
-    if (size != CONFIG_BLOCK_SZ){
+int check_valid(loff_t pos, size_t size){
+    if (size == 0 || !IS_ADDR_ALIGN(size)){
         kernel_alert("io size %ld should align to %d", size, CONFIG_BLOCK_SZ);
         return -EIO;
     }
+    if (pos < 0 || pos + size > disk.layout_size) {
+        kernel_alert("disk head reach the end");
+        return -EINVAL;
+    }
     return 0;
 }
 /******************************************************************************
@@ -98,17 +105,23 @@ static int      device_open(struct inode *, struct file *);
 static int      device_release(struct inode *, struct file *);
 static ssize_t  device_read(struct file *, char *, size_t, loff_t *);
 static ssize_t  device_write(struct file *, const char *, size_t, loff_t *);
+static ssize_t  device_read_iter(struct kiocb *, struct iov_iter *);
+static ssize_t  device_write_iter(struct kiocb *, struct iov_iter *);
 static loff_t   device_seek(struct file *, loff_t, int);
 static long     device_ioctl(struct file *, unsigned int, unsigned long);
+static int      device_mmap(struct file *, struct vm_area_struct *);
 /******************************************************************************
 * SECTION: Global var or structure definitions
 *******************************************************************************/
 static struct file_operations file_ops = {
     .read = device_read,
     .write = device_write,
+    .read_iter = device_read_iter,
+    .write_iter = device_write_iter,
     .open = device_open,
     .llseek = device_seek,
     .unlocked_ioctl = device_ioctl,
+    .mmap = device_mmap,
     .release = device_release
 };
 /******************************************************************************
@@ -119,57 +132,93 @@ static struct file_operations file_ops = {
  * 
  * @param file          Ignored
  * @param user_buffer   User space buffer
- * @param size          Must equal to Blocksize @CONFIG_BLOCK_SZ
- * @param offset        Ignored
+ * @param size          Multiple of Blocksize @CONFIG_BLOCK_SZ, served by one copy
+ * @param offset        Head of this open file, advanced by size
  * @return ssize_t      Bytes have been read 
  */
 static ssize_t 
 device_read(struct file *file, char *user_buffer, size_t size, loff_t *offset) {
-    IGNORE_ARG(offset);
     IGNORE_ARG(file);
-    int res = check_valid(size);
+    int res = check_valid(*offset, size);
     if(res < 0)
         return res;
-    if (copy_to_user(user_buffer, disk.head, CONFIG_BLOCK_SZ))
+    if (copy_to_user(user_buffer, disk.layout + *offset, size))
         return -EFAULT;
-    FORWARD_HEAD(disk, CONFIG_BLOCK_SZ);
+    *offset += size;
     INC_READCNT(disk);
-    return CONFIG_BLOCK_SZ;
+    return size;
 }
 /**
  * @brief Disk Write
  * 
  * @param file          Ignored
  * @param user_buffer   User space buffer, copy content from
- * @param size          Must equal to Blocksize @CONFIG_BLOCK_SZ
- * @param offset        Ignored
+ * @param size          Multiple of Blocksize @CONFIG_BLOCK_SZ, served by one copy
+ * @param offset        Head of this open file, advanced by size
  * @return ssize_t      Bytes have been written
  */
 static ssize_t 
 device_write(struct file *file, const char *user_buffer, size_t size, loff_t *offset) {
-    IGNORE_ARG(offset);
     IGNORE_ARG(file);
-    int res = check_valid(size);
+    int res = check_valid(*offset, size);
     if(res < 0)
         return res;
 
-    if (copy_from_user(disk.head, user_buffer, CONFIG_BLOCK_SZ))
+    if (copy_from_user(disk.layout + *offset, user_buffer, size))
+        return -EFAULT;
+    *offset += size;
+    INC_WRITECNT(disk);
+    return size;
+}
+/**
+ * @brief Disk Vectored Read (readv, io_submit)
+ * 
+ * @param iocb          ki_pos is the file's head, or the offset given to preadv
+ * @param to            Total length must be a multiple of @CONFIG_BLOCK_SZ
+ * @return ssize_t      Bytes have been read
+ */
+static ssize_t 
+device_read_iter(struct kiocb *iocb, struct iov_iter *to) {
+    size_t size = iov_iter_count(to);
+    int res = check_valid(iocb->ki_pos, size);
+    if(res < 0)
+        return res;
+    if (copy_to_iter(disk.layout + iocb->ki_pos, size, to) != size)
+        return -EFAULT;
+    iocb->ki_pos += size;
+    INC_READCNT(disk);
+    return size;
+}
+/**
+ * @brief Disk Vectored Write (writev, io_submit)
+ * 
+ * @param iocb          ki_pos is the file's head, or the offset given to pwritev
+ * @param from          Total length must be a multiple of @CONFIG_BLOCK_SZ
+ * @return ssize_t      Bytes have been written
+ */
+static ssize_t 
+device_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    size_t size = iov_iter_count(from);
+    int res = check_valid(iocb->ki_pos, size);
+    if(res < 0)
+        return res;
+    if (copy_from_iter(disk.layout + iocb->ki_pos, size, from) != size)
         return -EFAULT;
-    FORWARD_HEAD(disk, CONFIG_BLOCK_SZ);
+    iocb->ki_pos += size;
     INC_WRITECNT(disk);
-    return CONFIG_BLOCK_SZ;
+    return size;
 }
 /**
  * @brief Disk Seek
  * 
- * @param file          Ignored
+ * @param file          Its f_pos is the head moved by this seek
  * @param offset        Aligned to @CONFIG_BLOCK_SZ
- * @param whence        SEEK_CUR, SEEK_SET
+ * @param whence        SEEK_CUR, SEEK_SET, SEEK_END
  * @return loff_t       cur pos
  */
 static loff_t 
 device_seek(struct file *file, loff_t offset, int whence) {
-    IGNORE_ARG(file);
+    loff_t pos;
     if (!IS_ADDR_ALIGN(offset)) {
         kernel_alert("offset %lld must be aligned to block size %d", 
                       offset, CONFIG_BLOCK_SZ);
@@ -178,28 +227,35 @@ device_seek(struct file *file, loff_t offset, int whence) {
     switch (whence)
     {
     case SEEK_SET:
-        SET_HEAD(disk, offset);
+        pos = offset;
         break;
     case SEEK_CUR:
-        FORWARD_HEAD(disk, offset);
+        pos = file->f_pos + offset;
         break;
-    default:
+    case SEEK_END:
+        pos = disk.layout_size + offset;
         break;
+    default:
+        return -EINVAL;
     }
+    if (pos < 0 || pos > disk.layout_size) {
+        kernel_alert("seek to %lld out of disk", pos);
+        return -EINVAL;
+    }
+    file->f_pos = pos;
     INC_SEEKCNT(disk);
-    return GET_HEAD_POS(disk);
+    return pos;
 }
 /**
  * @brief Disk ioctl
  * 
- * @param file          Ignored
+ * @param file          Reset rewinds only this file's head
  * @param cmd           Command
  * @param arg           Args
  * @return long         State
  */
 static long 
 device_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
-    IGNORE_ARG(file);
     int ret;
     struct ddriver_state state;
     switch (cmd)
@@ -210,46 +266,58 @@ device_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
             return -EFAULT;
         break;
     case IOC_REQ_DEVICE_STATE:                        /* Device State */
-        state.read_cnt = disk.read_cnt;
-        state.write_cnt = disk.write_cnt;
-        state.seek_cnt = disk.seek_cnt;
+        state.read_cnt = atomic_read(&disk.read_cnt);
+        state.write_cnt = atomic_read(&disk.write_cnt);
+        state.seek_cnt = atomic_read(&disk.seek_cnt);
         ret = copy_to_user((int __user *)arg, &state, sizeof(struct ddriver_state));
         if (ret) 
             return -EFAULT;
         break;
     case IOC_REQ_DEVICE_RESET:                        /* Reset Device */
-        disk.head = disk.layout;
-        disk.read_cnt = 0;
-        disk.write_cnt = 0;
-        disk.seek_cnt = 0;
+        file->f_pos = 0;
+        atomic_set(&disk.read_cnt, 0);
+        atomic_set(&disk.write_cnt, 0);
+        atomic_set(&disk.seek_cnt, 0);
         break;
     case IOC_REQ_DEVICE_IO_SZ:
         ret = copy_to_user((int __user *)arg, &disk.iounit_size, sizeof(int));
         if (ret) 
             return -EFAULT;
         break;
+    case IOC_REQ_DEVICE_FLUSH:                        /* Barrier, writes land in layout synchronously */
+        break;
     default:
         break;
     }
     return 0;
 }
+/**
+ * @brief Disk mmap, maps the layout itself so accesses need no copy
+ * 
+ * @param file          Ignored
+ * @param vma           vm_pgoff and length must stay inside the disk
+ * @return int          state
+ */
+static int 
+device_mmap(struct file *file, struct vm_area_struct *vma) {
+    IGNORE_ARG(file);
+    return remap_vmalloc_range(vma, disk.layout, vma->vm_pgoff);
+}
 /**
  * @brief Disk Open
  * 
  * @param inode         Ignored
- * @param file          Ignored
+ * @param file          Each open gets its own head, starting at 0
  * @return int          state
  */
 static int 
 device_open(struct inode *inode, struct file *file) {
     IGNORE_ARG(inode);
-    IGNORE_ARG(file);
     
-    if (disk.open_count) {                            /* If device is open, return busy */
-        return -EBUSY;
-    }
-    RESET_HEAD(disk);                                 /* Everytime close device, reset head */
+    file->f_pos = 0;                                  /* Concurrent opens are allowed */
+    mutex_lock(&disk.lock);
     disk.open_count++;
+    mutex_unlock(&disk.lock);
     try_module_get(THIS_MODULE);
     return 0;
 }
@@ -266,7 +334,9 @@ device_release(struct inode *inode, struct file *file) {
                                                          Without this, the module would not unload. */
     IGNORE_ARG(inode);
     IGNORE_ARG(file);
+    mutex_lock(&disk.lock);
     disk.open_count--;
+    mutex_unlock(&disk.lock);
     module_put(THIS_MODULE);
     return 0;
 }
@@ -276,16 +346,28 @@ device_release(struct inode *inode, struct file *file) {
 static int __init 
 ddriver_init(void)
 {
-    int major_num = register_chrdev(0, DEVICE_NAME, &file_ops);   
+    int major_num;
+    if (disk_sz <= 0 || disk_sz % PAGE_SIZE != 0) {
+        kernel_alert("disk_sz %d must be a positive multiple of %lu", disk_sz, PAGE_SIZE);
+        return -EINVAL;
+    }
+    disk.layout = vmalloc_user(disk_sz);              /* Zeroed */
+    if (disk.layout == NULL) {
+        kernel_alert("Can't allocate %d bytes for disk", disk_sz);
+        return -ENOMEM;
+    }
+    disk.layout_size = disk_sz;
+
+    major_num = register_chrdev(0, DEVICE_NAME, &file_ops);   
                                                       /* Register an device */
     if (major_num < 0) {                              /* Register fail */
         kernel_alert("Can't register device, ret %d", major_num);
+        vfree(disk.layout);
         return major_num;
     } 
     else {                                            /* Register success */                                                  
         kernel_info("module loaded with device major number %d", major_num);
         disk.major_num = major_num;
-        memset(disk.layout, 0, CONFIG_DISK_SZ);
         return 0;
     }
     return 0;
@@ -299,6 +381,7 @@ ddriver_exit(void)
     if(major_num != 0){
         unregister_chrdev(major_num, DEVICE_NAME);
     }
+    vfree(disk.layout);
 }
 
 module_init(ddriver_init);
@@ -17,5 +17,6 @@ struct ddriver_state
 #define IOC_REQ_DEVICE_STATE    _IOR(IOC_MAGIC, 1, struct ddriver_state)
 #define IOC_REQ_DEVICE_RESET    _IO(IOC_MAGIC, 2)
 #define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, int)
+#define IOC_REQ_DEVICE_FLUSH    _IO(IOC_MAGIC, 5)
 
 #endif
\ No newline at end of file
@@ -1,8 +1,10 @@
+#define _GNU_SOURCE                                  /* fallocate */
 #include "stdio.h"
 #include "stdlib.h"
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <linux/falloc.h>
 #include "string.h"
 #include <linux/fs.h>
 #include "ddriver_ctl.h"
@@ -10,6 +12,12 @@
 #include "errno.h"
 #include <pwd.h>
 #include <time.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
 
 extern int errno;
 
@@ -22,6 +30,7 @@ extern int errno;
 *******************************************************************************/   
 #define DEVICE_NAME   "ddriver"
 #define DEVICE_LOG    "ddriver_log"
+#define DEVICE_TRACE  "ddriver_trace"
 
 #define user_info(fmt, ...)\
 	do {\
@@ -44,78 +53,444 @@ extern int errno;
 #define DRIVER_DESC     "A Fake disk driver in user space"
 #define DRIVER_VERSION  "0.1.0"
 
-#define CONFIG_DISK_SZ  (4 * 1024 * 1024)
+#define CONFIG_DISK_SZ  (4 * 1024 * 1024)         /* 默认几何参数，可由环境变量覆盖 */
 #define CONFIG_BLOCK_SZ (512)
+
+#define ENV_PROFILE     "DDRIVER_PROFILE"         /* hdd(默认) / ssd / ram */
+#define ENV_DISK_SZ     "DDRIVER_DISK_SZ"         /* 支持K/M/G后缀 */
+#define ENV_BLOCK_SZ    "DDRIVER_BLOCK_SZ"
+#define ENV_READ_LAT    "DDRIVER_READ_LAT"        /* 单位us */
+#define ENV_WRITE_LAT   "DDRIVER_WRITE_LAT"
+#define ENV_SEEK_LAT    "DDRIVER_SEEK_LAT"
+#define ENV_TRACK_NUM   "DDRIVER_TRACK_NUM"
+#define ENV_TRACE       "DDRIVER_TRACE"           /* 非空时将块级trace记录到DEVICE_TRACE */
+
+#define CONFIG_AIO_WORKERS  (4)
+
+#ifndef IOV_MAX
+#define IOV_MAX         (1024)
+#endif
 /******************************************************************************
 * SECTION: Macro Functions 
 *******************************************************************************/
+#define TRUE                    1
+#define FALSE                   0
 #define IGNORE_ARG(arg)         ((void)arg)
-#define IS_ADDR_ALIGN(addr)     (addr % CONFIG_BLOCK_SZ == 0)
-#define ADDR_ROUND_UP(addr)     ((addr / CONFIG_BLOCK_SZ) * CONFIG_BLOCK_SZ)
+#define IS_ADDR_ALIGN(addr)     ((addr) % disk.iounit_size == 0)
+#define ADDR_ROUND_UP(addr)     (((addr) / disk.iounit_size) * disk.iounit_size)
 
-#define INC_READCNT(disk)       (disk.read_cnt++)
-#define INC_WRITECNT(disk)      (disk.write_cnt++)
-#define INC_SEEKCNT(disk)       (disk.seek_cnt++)
+#define INC_READCNT(disk)       (__sync_fetch_and_add(&disk.stats.read_cnt, 1))
+#define INC_WRITECNT(disk)      (__sync_fetch_and_add(&disk.stats.write_cnt, 1))
+#define INC_SEEKCNT(disk)       (__sync_fetch_and_add(&disk.stats.seek_cnt, 1))
+#define ADD_STAT(disk, f, val)  (__sync_fetch_and_add(&disk.stats.f, (val)))
 
-#define RW_DELAY(disk, rw_ops)  (usleep(disk.rw_ops##_lat * 1000))
+#define SET_HEAD(disk, ofs)     (disk.head = (ofs))
+#define FORWARD_HEAD(disk, dis) (disk.head += (dis))
+
+#define RW_DELAY(disk, rw_ops)  (disk.rw_ops##_lat ? usleep(disk.rw_ops##_lat) : 0)
 /******************************************************************************
 * SECTION: Type definitions
 *******************************************************************************/
 struct ddriver
 {
     int  ddriver_fd;                                 /* Disk ddriver_fd */
-    int  read_cnt;
-    int  write_cnt;
-    int  seek_cnt;
-    int  read_lat;
-    int  write_lat;
-    int  seek_lat;
+    struct ddriver_stats stats;
+    off_t last_end;                                  /* 上次传输结束的位置，用于区分顺序/随机 */
+    int  read_lat;                                   /* us */
+    int  write_lat;                                  /* us */
+    int  seek_lat;                                   /* us per 360 degree */
     int  track_num;
     int  major_num;
-    int  layout_size;
+    off_t layout_size;
     int  iounit_size;
+    off_t head;                                      /* Disk Head, 上次IO结束的位置 */
+    char *layout;                                    /* mmap模式下的磁盘映射，NULL为文件模式 */
+    pthread_mutex_t head_lock;                       /* 保护head，允许多线程positional IO */
+};
+struct aio_uring
+{
+    int  ring_fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_sz;
+    size_t cq_sz;
+    size_t sqes_sz;
+};
+
+struct aio_ctx
+{
+    int  fd;
+    int  depth;
+    int  inflight;                                   /* 已提交未收割的请求数 */
+    int  use_uring;
+    struct aio_uring ring;
+                                                     /* io_uring不可用时退化为线程池 */
+    pthread_t workers[CONFIG_AIO_WORKERS];
+    pthread_mutex_t lock;
+    pthread_cond_t  pending_cond;
+    pthread_cond_t  done_cond;
+    struct ddriver_aio **pending;                    /* 环形队列，容量depth */
+    int  pending_head;
+    int  pending_cnt;
+    struct ddriver_aio **done;                       /* 环形队列，容量depth */
+    int  done_head;
+    int  done_cnt;
+    int  stop;
 };
 /******************************************************************************
 * SECTION: Global Variable
 *******************************************************************************/
 /* reference: https://en.wikipedia.org/wiki/Hard_disk_drive_performance_characteristics */
 struct ddriver disk = {
-    .read_cnt    = 0,
-    .write_cnt   = 0,
-    .seek_cnt    = 0,
-    .read_lat    = 2,       /* 2ms */       
-    .write_lat   = 1,       /* 1ms */
-    .seek_lat    = 4,       /* 4.17ms per 360 degree */
+    .stats       = { 0 },
+    .last_end    = 0,
+    .read_lat    = 2000,    /* 2ms */       
+    .write_lat   = 1000,    /* 1ms */
+    .seek_lat    = 4170,    /* 4.17ms per 360 degree */
     .major_num   = 0,
     .track_num   = 100,
     .layout_size = CONFIG_DISK_SZ,
-    .iounit_size = CONFIG_BLOCK_SZ
+    .iounit_size = CONFIG_BLOCK_SZ,
+    .head        = 0,
+    .layout      = NULL,
+    .head_lock   = PTHREAD_MUTEX_INITIALIZER
 };
 
 FILE *debugf = NULL;
+FILE *tracef = NULL;
+uint64_t trace_epoch = 0;                            /* trace时间戳的零点，即设备打开时刻 */
+
+struct aio_ctx aio = {
+    .fd           = -1,
+    .depth        = 0,
+    .lock         = PTHREAD_MUTEX_INITIALIZER,
+    .pending_cond = PTHREAD_COND_INITIALIZER,
+    .done_cond    = PTHREAD_COND_INITIALIZER
+};
 /******************************************************************************
 * SECTION: Helper Functions
 *******************************************************************************/
 int check_valid(size_t size) {
-    if (size != CONFIG_BLOCK_SZ){
-        user_alert("io size %ld should align to %d", size, CONFIG_BLOCK_SZ);
+    if (size != disk.iounit_size){
+        user_alert("io size %ld should align to %d", size, disk.iounit_size);
         return -EIO;
     }
     return 0;
 }
 
+int check_valid_vec(const struct iovec *iov, int iovcnt, size_t *size) {
+    int i;
+    *size = 0;
+    if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+        user_alert("iov count %d out of range [1, %d]", iovcnt, IOV_MAX);
+        return -EINVAL;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0 || !IS_ADDR_ALIGN(iov[i].iov_len)) {
+            user_alert("iov[%d] size %ld should align to %d", 
+                       i, iov[i].iov_len, disk.iounit_size);
+            return -EIO;
+        }
+        *size += iov[i].iov_len;
+    }
+    return 0;
+}
+
+/**
+ * @brief 将磁盘头移动到offset，并在IO结束后停在offset + size
+ * 
+ * @return off_t 移动前磁盘头的位置
+ */
+off_t claim_head(off_t offset, size_t size) {
+    off_t start;
+    pthread_mutex_lock(&disk.head_lock);
+    start = disk.head;
+    SET_HEAD(disk, offset + size);
+    pthread_mutex_unlock(&disk.head_lock);
+    return start;
+}
+/**
+ * @brief 顺序接口从磁盘头处传输size字节，读取与前移磁盘头在同一临界区内
+ * 
+ * @return off_t 本次传输的起始位置
+ */
+off_t advance_head(size_t size) {
+    off_t start;
+    pthread_mutex_lock(&disk.head_lock);
+    start = disk.head;
+    FORWARD_HEAD(disk, size);
+    pthread_mutex_unlock(&disk.head_lock);
+    return start;
+}
+
+/**
+ * @brief mmap模式下在映射区与iov之间拷贝数据
+ * 
+ * @return ssize_t 拷贝的字节数
+ */
+ssize_t layout_copy(const struct iovec *iov, int iovcnt, off_t offset, int is_write) {
+    int i;
+    ssize_t done = 0;
+    for (i = 0; i < iovcnt; i++) {
+        if (offset + done + iov[i].iov_len > disk.layout_size) {
+            user_alert("disk head reach the end");
+            errno = EINVAL;                          /* 与系统调用保持一致 */
+            return done ? done : -1;
+        }
+        if (is_write) {
+            memcpy(disk.layout + offset + done, iov[i].iov_base, iov[i].iov_len);
+        }
+        else {
+            memcpy(iov[i].iov_base, disk.layout + offset + done, iov[i].iov_len);
+        }
+        done += iov[i].iov_len;
+    }
+    return done;
+}
+/**
+ * @brief 切换mmap模式，关闭时先msync落盘
+ * 
+ * @return int 0成功，否则为错误号
+ */
+int layout_map(int fd, int enable) {
+    char *layout;
+    if (enable && disk.layout == NULL) {
+        layout = mmap(NULL, disk.layout_size, PROT_READ | PROT_WRITE, 
+                      MAP_SHARED, fd, 0);
+        if (layout == MAP_FAILED) {
+            user_panic("mmap error: %s", strerror(errno));
+            return -errno;
+        }
+        disk.layout = layout;
+    }
+    else if (!enable && disk.layout != NULL) {
+        msync(disk.layout, disk.layout_size, MS_SYNC);
+        munmap(disk.layout, disk.layout_size);
+        disk.layout = NULL;
+    }
+    return 0;
+}
+
+uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+/**
+ * @brief 追加一条trace记录，单次fwrite由stdio加锁，多线程下记录不会交错
+ */
+void trace_record(int op, off_t offset, size_t size, uint64_t start_us) {
+    struct ddriver_trace_rec rec;
+    if (tracef == NULL) {
+        return;
+    }
+    rec.ts_us  = start_us - trace_epoch;
+    rec.offset = offset;
+    rec.size   = size;
+    rec.op     = op;
+    fwrite(&rec, sizeof(struct ddriver_trace_rec), 1, tracef);
+}
+/**
+ * @brief 打开trace文件并写入文件头，失败时只告警不影响设备使用
+ */
+void trace_open(const char *path) {
+    struct ddriver_trace_hdr hdr = {
+        .magic    = DDRIVER_TRACE_MAGIC,
+        .version  = DDRIVER_TRACE_VERSION,
+        .disk_sz  = disk.layout_size,
+        .block_sz = disk.iounit_size
+    };
+    tracef = fopen(path, "w");
+    if (tracef == NULL) {
+        user_alert("can't open trace: %s", path);
+        return;
+    }
+    trace_epoch = now_us();
+    fwrite(&hdr, sizeof(struct ddriver_trace_hdr), 1, tracef);
+}
+/**
+ * @brief 记录一次数据传输：请求数、字节数、顺序/随机以及耗时直方图
+ * 
+ * @param offset 传输起始位置，与上次传输的结束位置相同视为顺序访问
+ * @param start_us 请求开始的时间
+ */
+void account_io(int is_write, off_t offset, size_t bytes, uint64_t start_us) {
+    uint64_t lat = now_us() - start_us;
+    int bucket = lat < 2 ? 0 : 63 - __builtin_clzll(lat);
+    off_t last = __atomic_exchange_n(&disk.last_end, offset + bytes, __ATOMIC_RELAXED);
+
+    if (bucket >= DDRIVER_LAT_BUCKETS) {
+        bucket = DDRIVER_LAT_BUCKETS - 1;
+    }
+    if (is_write) {
+        INC_WRITECNT(disk);
+        ADD_STAT(disk, write_bytes, bytes);
+        ADD_STAT(disk, write_lat_hist[bucket], 1);
+    }
+    else {
+        INC_READCNT(disk);
+        ADD_STAT(disk, read_bytes, bytes);
+        ADD_STAT(disk, read_lat_hist[bucket], 1);
+    }
+    if (last == offset) {
+        ADD_STAT(disk, seq_cnt, 1);
+    }
+    else {
+        ADD_STAT(disk, rand_cnt, 1);
+    }
+    trace_record(is_write ? DDRIVER_TRACE_WRITE : DDRIVER_TRACE_READ, offset, bytes, start_us);
+}
+
+/**
+ * @brief FUA写入，只持久化本次写入的范围：文件模式用RWF_DSYNC，
+ *        内核不支持时退化为写入后fdatasync；mmap模式按页msync
+ * 
+ * @return ssize_t 写入的字节数，失败返回-1并设置errno
+ */
+ssize_t layout_write_fua(int fd, const struct iovec *iov, off_t offset) {
+    ssize_t ret;
+    off_t start;
+    if (disk.layout != NULL) {
+        ret = layout_copy(iov, 1, offset, TRUE);
+        start = offset - offset % sysconf(_SC_PAGESIZE);
+        if (ret > 0 && msync(disk.layout + start, offset + ret - start, MS_SYNC) < 0) {
+            return -1;
+        }
+        return ret;
+    }
+    ret = pwritev2(fd, iov, 1, offset, RWF_DSYNC);
+    if (ret < 0 && errno == EOPNOTSUPP) {
+        ret = pwrite(fd, iov->iov_base, iov->iov_len, offset);
+        if (ret >= 0 && fdatasync(fd) < 0) {
+            return -1;
+        }
+    }
+    return ret;
+}
+/**
+ * @brief 将[offset, offset + len)清零并归还后端文件的空间，优先打洞，
+ *        文件系统不支持时依次退化为ZERO_RANGE与逐段写0
+ * 
+ * @return int 0成功，否则为错误号
+ */
+int layout_discard(int fd, off_t offset, off_t len) {
+    char buf[4096] = {'\0'};
+    off_t done;
+    ssize_t ret;
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, len) == 0
+        || fallocate(fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE, offset, len) == 0) {
+        return 0;
+    }
+    for (done = 0; done < len; done += ret) {
+        ret = pwrite(fd, buf, len - done < sizeof(buf) ? len - done : sizeof(buf), 
+                     offset + done);
+        if (ret < 0) {
+            user_panic("discard error: %s", strerror(errno));
+            return -errno;
+        }
+    }
+    return 0;
+}
+
 int emulate_rotate(int fd, off_t start, off_t end) {
-    int bytes_per_track = disk.layout_size / disk.track_num;
-    int lat_per_track = disk.seek_lat;
-    int distance = abs(end - start) % bytes_per_track; 
+    off_t bytes_per_track = disk.layout_size / disk.track_num;
+    off_t lat_per_track = disk.seek_lat;
+    off_t distance = (end > start ? end - start : start - end) % bytes_per_track; 
     
-    if (distance == 0) {
+    ADD_STAT(disk, seek_dist, end > start ? end - start : start - end);
+    if (distance == 0 || lat_per_track == 0) {
         return 0;
     }
 
-    usleep(distance * lat_per_track / bytes_per_track * 1000);
+    usleep(distance * lat_per_track / bytes_per_track);
     return 0;
 }
+/**
+ * @brief 解析带K/M/G后缀的大小
+ * 
+ * @return long long 解析失败返回-1
+ */
+long long parse_size(const char *str) {
+    char *end;
+    long long val = strtoll(str, &end, 0);
+    switch (*end) {
+    case 'g': case 'G': val <<= 10;                  /* fall through */
+    case 'm': case 'M': val <<= 10;                  /* fall through */
+    case 'k': case 'K': val <<= 10; end++; break;
+    default: break;
+    }
+    return (end == str || *end != '\0' || val < 0) ? -1 : val;
+}
+/**
+ * @brief 从环境变量读取几何参数与延迟模型，非法取值保持默认
+ */
+void load_config() {
+    char *env;
+    long long val;
+
+    if ((env = getenv(ENV_PROFILE)) != NULL) {
+        if (strcmp(env, "ssd") == 0) {               /* 无寻道，读写延迟为us级 */
+            disk.read_lat  = 100;
+            disk.write_lat = 30;
+            disk.seek_lat  = 0;
+        }
+        else if (strcmp(env, "ram") == 0) {          /* 关闭延迟模型 */
+            disk.read_lat  = 0;
+            disk.write_lat = 0;
+            disk.seek_lat  = 0;
+        }
+        else if (strcmp(env, "hdd") != 0) {
+            user_alert("unknown profile %s, use hdd", env);
+        }
+    }
+    if ((env = getenv(ENV_BLOCK_SZ)) != NULL) {
+        val = parse_size(env);
+        if (val < 512 || val > INT_MAX || (val & (val - 1)) != 0) {
+            user_alert("block size %s should be a power of 2 no less than 512", env);
+        }
+        else {
+            disk.iounit_size = val;
+        }
+    }
+    if ((env = getenv(ENV_DISK_SZ)) != NULL) {
+        val = parse_size(env);
+        if (val <= 0 || val % disk.iounit_size != 0) {
+            user_alert("disk size %s should be a multiple of %d", env, disk.iounit_size);
+        }
+        else {
+            disk.layout_size = val;
+        }
+    }
+    if ((env = getenv(ENV_READ_LAT)) != NULL && (val = parse_size(env)) >= 0) {
+        disk.read_lat = val;
+    }
+    if ((env = getenv(ENV_WRITE_LAT)) != NULL && (val = parse_size(env)) >= 0) {
+        disk.write_lat = val;
+    }
+    if ((env = getenv(ENV_SEEK_LAT)) != NULL && (val = parse_size(env)) >= 0) {
+        disk.seek_lat = val;
+    }
+    if ((env = getenv(ENV_TRACK_NUM)) != NULL && (val = parse_size(env)) > 0) {
+        disk.track_num = val;
+    }
+    if (disk.layout_size / disk.track_num < disk.iounit_size) {
+        disk.track_num = disk.layout_size / disk.iounit_size;
+    }
+}
+/******************************************************************************
+* SECTION: Function definitions
+*******************************************************************************/
+int ddriver_aio_destroy(int fd);
+int ddriver_pwrite2(int fd, char *buf, size_t size, off_t offset, int flags);
 /******************************************************************************
 * SECTION: Global Function Implementation
 *******************************************************************************/
@@ -125,12 +500,16 @@ int emulate_rotate(int fd, off_t start, off_t end) {
  * @return int 文件描述符
  */
 int ddriver_open(char *path) {
-    int fd, ret = 0;
+    int fd;
     char device_path[128] = {0};
     char log_path[128] = {0};
+    char trace_path[128] = {0};
+    char *env;
+    struct stat st;
     
     sprintf(device_path, "%s/" DEVICE_NAME, getpwuid(getuid())->pw_dir);
     sprintf(log_path, "%s/" DEVICE_LOG, getpwuid(getuid())->pw_dir);
+    sprintf(trace_path, "%s/" DEVICE_TRACE, getpwuid(getuid())->pw_dir);
     
     if (strcmp(device_path, path) != 0) {
         user_panic("wrong path [%s], should be [%s]", path, device_path);
@@ -147,11 +526,6 @@ int ddriver_open(char *path) {
         user_panic("can't open device: %d", fd);
         return fd;
     }
-    ret = posix_fallocate(fd, 0, CONFIG_DISK_SZ);
-    if (ret < 0) {
-        user_panic("low space");
-        return ret;
-    }
 
     debugf = fopen(log_path, "w+");
     if (debugf == NULL) {
@@ -159,6 +533,20 @@ int ddriver_open(char *path) {
         return -1;
     }
 
+    load_config();
+    if (fstat(fd, &st) < 0) {
+        user_panic("can't stat device: %s", strerror(errno));
+        return -errno;
+    }
+    if (st.st_size < disk.layout_size                /* 只扩展大小，保持后端文件稀疏 */
+        && ftruncate(fd, disk.layout_size) < 0) {
+        user_panic("low space");
+        return -errno;
+    }
+    if ((env = getenv(ENV_TRACE)) != NULL && *env != '\0') {
+        trace_open(trace_path);
+    }
+
     return fd;
 }
 /**
@@ -168,6 +556,12 @@ int ddriver_open(char *path) {
  * @return int 
  */
 int ddriver_close(int fd) {
+    ddriver_aio_destroy(fd);
+    layout_map(fd, FALSE);
+    if (tracef != NULL) {
+        fclose(tracef);
+        tracef = NULL;
+    }
     return close(fd) && fclose(debugf);
 }
 /**
@@ -179,23 +573,26 @@ int ddriver_close(int fd) {
  * @return int 
  */
 int ddriver_seek(int fd, off_t offset, int whence){
-    int ret = 0;
-    int cur = 0;
+    uint64_t start = now_us();
+    off_t ret = 0;
+    off_t cur = 0;
 
     if (!IS_ADDR_ALIGN(offset)) {
         user_alert("offset %ld must be aligned to block size %d", 
-                      offset, CONFIG_BLOCK_SZ);
+                      offset, disk.iounit_size);
         return -EINVAL;
     }
 
     INC_SEEKCNT(disk);
-    cur = lseek(fd, 0, SEEK_CUR);
-    ret = lseek(fd, offset, whence);
+    ret = whence == SEEK_CUR ? disk.head + offset :  /* 顺序读写按磁盘头定位，不使用文件偏移 */
+          whence == SEEK_END ? disk.layout_size + offset : offset;
     if (ret < 0) {
         user_panic("seek error: %s", strerror(errno));
         return ret;
     }
+    cur = claim_head(ret, 0);
     emulate_rotate(fd, cur, ret);
+    trace_record(DDRIVER_TRACE_SEEK, ret, 0, start);
     return ret;
 }
 /**
@@ -207,15 +604,25 @@ int ddriver_seek(int fd, off_t offset, int whence){
  * @return int 
  */
 int ddriver_write(int fd, char *buf, size_t size){
+    uint64_t start = now_us();
+    off_t offset;
     int res = check_valid(size);
     if(res < 0)
         return res;
         
+    offset = advance_head(size);
     RW_DELAY(disk, write);
-    write(fd, buf, size);
+    if (disk.layout != NULL) {
+        struct iovec iov = { .iov_base = buf, .iov_len = size };
+        if (layout_copy(&iov, 1, offset, TRUE) < 0)
+            return -errno;
+    }
+    else {
+        pwrite(fd, buf, size, offset);
+    }
 
-    INC_WRITECNT(disk);
-    return CONFIG_BLOCK_SZ;
+    account_io(TRUE, offset, size, start);
+    return size;
 }
 /**
  * @brief 
@@ -226,15 +633,173 @@ int ddriver_write(int fd, char *buf, size_t size){
  * @return int 
  */
 int ddriver_read(int fd, char *buf, size_t size){
+    uint64_t start = now_us();
+    off_t offset;
     int res = check_valid(size);
     if(res < 0)
         return res;
 
+    offset = advance_head(size);
+    RW_DELAY(disk, read);
+    if (disk.layout != NULL) {
+        struct iovec iov = { .iov_base = buf, .iov_len = size };
+        if (layout_copy(&iov, 1, offset, FALSE) < 0)
+            return -errno;
+    }
+    else {
+        pread(fd, buf, size, offset);
+    }
+
+    account_io(FALSE, offset, size, start);
+    return size;
+}
+/**
+ * @brief 多块写入，一次请求写入连续的若干块，只计一次写延迟
+ * 
+ * @param fd 
+ * @param iov 每段大小必须是IO单位的整数倍
+ * @param iovcnt 
+ * @return int 写入的字节数
+ */
+int ddriver_writev(int fd, const struct iovec *iov, int iovcnt){
+    uint64_t start = now_us();
+    off_t offset;
+    size_t size;
+    ssize_t ret;
+    int res = check_valid_vec(iov, iovcnt, &size);
+    if(res < 0)
+        return res;
+
+    offset = advance_head(size);
+    RW_DELAY(disk, write);
+    ret = disk.layout != NULL ? layout_copy(iov, iovcnt, offset, TRUE) 
+                              : pwritev(fd, iov, iovcnt, offset);
+    if (ret < 0) {
+        user_panic("writev error: %s", strerror(errno));
+        return -errno;
+    }
+
+    account_io(TRUE, offset, ret, start);
+    return ret;
+}
+/**
+ * @brief 多块读出，一次请求读出连续的若干块，只计一次读延迟
+ * 
+ * @param fd 
+ * @param iov 每段大小必须是IO单位的整数倍
+ * @param iovcnt 
+ * @return int 读出的字节数
+ */
+int ddriver_readv(int fd, const struct iovec *iov, int iovcnt){
+    uint64_t start = now_us();
+    off_t offset;
+    size_t size;
+    ssize_t ret;
+    int res = check_valid_vec(iov, iovcnt, &size);
+    if(res < 0)
+        return res;
+
+    offset = advance_head(size);
+    RW_DELAY(disk, read);
+    ret = disk.layout != NULL ? layout_copy(iov, iovcnt, offset, FALSE) 
+                              : preadv(fd, iov, iovcnt, offset);
+    if (ret < 0) {
+        user_panic("readv error: %s", strerror(errno));
+        return -errno;
+    }
+
+    account_io(FALSE, offset, ret, start);
+    return ret;
+}
+/**
+ * @brief 定位写入，不依赖也不改变文件偏移，可多线程并发调用
+ * 
+ * @param fd 
+ * @param buf 
+ * @param size 必须是IO单位的整数倍
+ * @param offset 必须与IO单位对齐
+ * @return int 写入的字节数
+ */
+int ddriver_pwrite(int fd, char *buf, size_t size, off_t offset){
+    return ddriver_pwrite2(fd, buf, size, offset, 0);
+}
+/**
+ * @brief 带标志的定位写入
+ * 
+ * @param flags DDRIVER_WRITE_FUA：返回前数据已持久化
+ * @return int 写入的字节数
+ */
+int ddriver_pwrite2(int fd, char *buf, size_t size, off_t offset, int flags){
+    uint64_t start = now_us();
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+    size_t total;
+    ssize_t ret;
+    off_t cur;
+    int res = check_valid_vec(&iov, 1, &total);
+    if(res < 0)
+        return res;
+    if (!IS_ADDR_ALIGN(offset)) {
+        user_alert("offset %ld must be aligned to block size %d", 
+                      offset, disk.iounit_size);
+        return -EINVAL;
+    }
+
+    cur = claim_head(offset, size);
+    if (cur != offset) {
+        INC_SEEKCNT(disk);
+        emulate_rotate(fd, cur, offset);
+    }
+    RW_DELAY(disk, write);
+    ret = flags & DDRIVER_WRITE_FUA ? layout_write_fua(fd, &iov, offset) :
+          disk.layout != NULL       ? layout_copy(&iov, 1, offset, TRUE) 
+                                    : pwrite(fd, buf, size, offset);
+    if (ret < 0) {
+        user_panic("pwrite error: %s", strerror(errno));
+        return -errno;
+    }
+
+    account_io(TRUE, offset, ret, start);
+    return ret;
+}
+/**
+ * @brief 定位读出，不依赖也不改变文件偏移，可多线程并发调用
+ * 
+ * @param fd 
+ * @param buf 
+ * @param size 必须是IO单位的整数倍
+ * @param offset 必须与IO单位对齐
+ * @return int 读出的字节数
+ */
+int ddriver_pread(int fd, char *buf, size_t size, off_t offset){
+    uint64_t start = now_us();
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+    size_t total;
+    ssize_t ret;
+    off_t cur;
+    int res = check_valid_vec(&iov, 1, &total);
+    if(res < 0)
+        return res;
+    if (!IS_ADDR_ALIGN(offset)) {
+        user_alert("offset %ld must be aligned to block size %d", 
+                      offset, disk.iounit_size);
+        return -EINVAL;
+    }
+
+    cur = claim_head(offset, size);
+    if (cur != offset) {
+        INC_SEEKCNT(disk);
+        emulate_rotate(fd, cur, offset);
+    }
     RW_DELAY(disk, read);
-    read(fd, buf, size);
+    ret = disk.layout != NULL ? layout_copy(&iov, 1, offset, FALSE) 
+                              : pread(fd, buf, size, offset);
+    if (ret < 0) {
+        user_panic("pread error: %s", strerror(errno));
+        return -errno;
+    }
 
-    INC_READCNT(disk);
-    return CONFIG_BLOCK_SZ;
+    account_io(FALSE, offset, ret, start);
+    return ret;
 }
 /**
  * @brief 
@@ -246,34 +811,414 @@ int ddriver_read(int fd, char *buf, size_t size){
  */
 int ddriver_ioctl(int fd, unsigned long cmd, void *arg){
     struct ddriver_state state;
+    struct ddriver_geometry geo;
+    struct ddriver_discard range;
+    int size, ret;
     switch (cmd)
     {
-    case IOC_REQ_DEVICE_SIZE:                         /* Device Size */
-        memcpy(arg, &disk.layout_size, sizeof(int));
+    case IOC_REQ_DEVICE_SIZE:                         /* Device Size, 超过int时截断 */
+        size = disk.layout_size > INT_MAX ? ADDR_ROUND_UP(INT_MAX) : disk.layout_size;
+        memcpy(arg, &size, sizeof(int));
         break;
     case IOC_REQ_DEVICE_STATE:                        /* Device State */
-        state.read_cnt = disk.read_cnt;
-        state.write_cnt = disk.write_cnt;
-        state.seek_cnt = disk.seek_cnt;
+        state.read_cnt = disk.stats.read_cnt;
+        state.write_cnt = disk.stats.write_cnt;
+        state.seek_cnt = disk.stats.seek_cnt;
         memcpy(arg, &state, sizeof(struct ddriver_state));
         break;
     case IOC_REQ_DEVICE_RESET:                        /* Reset Device */
-        lseek(fd, 0, SEEK_SET);
-        char buf[4096] = {'\0'};
-        for (size_t i = 0; i < CONFIG_DISK_SZ; i += 4096)
-        {
-            write(fd, buf, 4096);
+        ret = layout_discard(fd, 0, disk.layout_size);
+        if (ret < 0) {
+            return ret;
         }
         lseek(fd, 0, SEEK_SET);
-        disk.read_cnt = 0;
-        disk.write_cnt = 0;
-        disk.seek_cnt = 0;
+        SET_HEAD(disk, 0);
+        disk.last_end = 0;
+        memset(&disk.stats, 0, sizeof(struct ddriver_stats));
         break;
     case IOC_REQ_DEVICE_IO_SZ:
         memcpy(arg, &disk.iounit_size, sizeof(int));
         break;
+    case IOC_REQ_DEVICE_GEOMETRY:                     /* Geometry and Latency Model */
+        geo.disk_sz   = disk.layout_size;
+        geo.block_sz  = disk.iounit_size;
+        geo.track_num = disk.track_num;
+        geo.read_lat  = disk.read_lat;
+        geo.write_lat = disk.write_lat;
+        geo.seek_lat  = disk.seek_lat;
+        memcpy(arg, &geo, sizeof(struct ddriver_geometry));
+        break;
+    case IOC_REQ_DEVICE_STATS:                        /* Extended Statistics */
+        memcpy(arg, &disk.stats, sizeof(struct ddriver_stats));
+        break;
+    case IOC_REQ_DEVICE_DISCARD:                      /* Discard (TRIM) a Range */
+        memcpy(&range, arg, sizeof(struct ddriver_discard));
+        if (!IS_ADDR_ALIGN(range.offset) || !IS_ADDR_ALIGN(range.len)
+            || range.offset + range.len > disk.layout_size) {
+            user_alert("discard [%lu, +%lu) must be aligned to %d and inside the disk", 
+                       range.offset, range.len, disk.iounit_size);
+            return -EINVAL;
+        }
+        return range.len ? layout_discard(fd, range.offset, range.len) : 0;
+    case IOC_REQ_DEVICE_MMAP:                         /* Switch mmap Backend */
+        return layout_map(fd, *(int *)arg);
+    case IOC_REQ_DEVICE_FLUSH:                        /* Persist Device and Trace */
+        if (tracef != NULL) {
+            trace_record(DDRIVER_TRACE_FLUSH, 0, 0, now_us());
+            fflush(tracef);
+        }
+        if ((disk.layout != NULL ? msync(disk.layout, disk.layout_size, MS_SYNC) 
+                                 : fdatasync(fd)) < 0) {
+            user_panic("flush error: %s", strerror(errno));
+            return -errno;
+        }
+        break;
     default:
         break;
     }
     return 0;
+}
+/******************************************************************************
+* SECTION: Async IO Implementation
+*******************************************************************************/
+int uring_setup(int depth) {
+    struct aio_uring *ring = &aio.ring;
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring->ring_fd = syscall(__NR_io_uring_setup, depth, &params);
+    if (ring->ring_fd < 0) {
+        return -errno;
+    }
+    ring->sq_sz   = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_sz   = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_sz = params.sq_entries * sizeof(struct io_uring_sqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->sq_sz = ring->cq_sz > ring->sq_sz ? ring->cq_sz : ring->sq_sz;
+        ring->cq_sz = ring->sq_sz;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_sz, PROT_READ | PROT_WRITE, 
+                        MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        close(ring->ring_fd);
+        return -errno;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    }
+    else {
+        ring->cq_ptr = mmap(NULL, ring->cq_sz, PROT_READ | PROT_WRITE, 
+                            MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            munmap(ring->sq_ptr, ring->sq_sz);
+            close(ring->ring_fd);
+            return -errno;
+        }
+    }
+    ring->sqes = mmap(NULL, ring->sqes_sz, PROT_READ | PROT_WRITE, 
+                      MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_ptr != ring->sq_ptr)
+            munmap(ring->cq_ptr, ring->cq_sz);
+        munmap(ring->sq_ptr, ring->sq_sz);
+        close(ring->ring_fd);
+        return -errno;
+    }
+
+    ring->sq_head  = (unsigned *)((char *)ring->sq_ptr + params.sq_off.head);
+    ring->sq_tail  = (unsigned *)((char *)ring->sq_ptr + params.sq_off.tail);
+    ring->sq_mask  = (unsigned *)((char *)ring->sq_ptr + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)((char *)ring->sq_ptr + params.sq_off.array);
+    ring->cq_head  = (unsigned *)((char *)ring->cq_ptr + params.cq_off.head);
+    ring->cq_tail  = (unsigned *)((char *)ring->cq_ptr + params.cq_off.tail);
+    ring->cq_mask  = (unsigned *)((char *)ring->cq_ptr + params.cq_off.ring_mask);
+    ring->cqes     = (struct io_uring_cqe *)((char *)ring->cq_ptr + params.cq_off.cqes);
+    return 0;
+}
+
+void uring_teardown() {
+    struct aio_uring *ring = &aio.ring;
+    munmap(ring->sqes, ring->sqes_sz);
+    if (ring->cq_ptr != ring->sq_ptr)
+        munmap(ring->cq_ptr, ring->cq_sz);
+    munmap(ring->sq_ptr, ring->sq_sz);
+    close(ring->ring_fd);
+}
+/**
+ * @brief 线程池工作线程，逐个取出请求并以定位IO完成
+ */
+void* aio_worker(void *arg) {
+    struct ddriver_aio *req;
+    IGNORE_ARG(arg);
+    while (TRUE) {
+        pthread_mutex_lock(&aio.lock);
+        while (aio.pending_cnt == 0 && !aio.stop) {
+            pthread_cond_wait(&aio.pending_cond, &aio.lock);
+        }
+        if (aio.pending_cnt == 0) {                  /* stop且队列已空 */
+            pthread_mutex_unlock(&aio.lock);
+            return NULL;
+        }
+        req = aio.pending[aio.pending_head];
+        aio.pending_head = (aio.pending_head + 1) % aio.depth;
+        aio.pending_cnt--;
+        pthread_mutex_unlock(&aio.lock);
+
+        req->res = req->op == DDRIVER_AIO_WRITE ? 
+                   ddriver_pwrite2(aio.fd, req->buf, req->size, req->offset, req->flags) :
+                   ddriver_pread(aio.fd, req->buf, req->size, req->offset);
+
+        pthread_mutex_lock(&aio.lock);
+        aio.done[(aio.done_head + aio.done_cnt) % aio.depth] = req;
+        aio.done_cnt++;
+        pthread_cond_signal(&aio.done_cond);
+        pthread_mutex_unlock(&aio.lock);
+    }
+}
+/**
+ * @brief io_uring路径下模拟内核已取走的一批请求的磁盘延迟：逐个移动磁头，
+ *        整批只计一次读写延迟。请求数、字节数与耗时在收割时统计
+ */
+void emulate_batch(struct ddriver_aio *reqs, int nr) {
+    int i, has_read = FALSE, has_write = FALSE;
+    off_t cur;
+    for (i = 0; i < nr; i++) {
+        reqs[i].submit_us = now_us();
+        cur = claim_head(reqs[i].offset, reqs[i].size);
+        if (cur != reqs[i].offset) {
+            INC_SEEKCNT(disk);
+            emulate_rotate(aio.fd, cur, reqs[i].offset);
+        }
+        if (reqs[i].op == DDRIVER_AIO_WRITE) {
+            has_write = TRUE;
+        }
+        else {
+            has_read = TRUE;
+        }
+    }
+    if (has_read)
+        RW_DELAY(disk, read);
+    if (has_write)
+        RW_DELAY(disk, write);
+}
+/**
+ * @brief 初始化异步IO队列，优先使用io_uring，失败则退化为线程池
+ * 
+ * @param fd 
+ * @param depth 最多同时在途的请求数
+ * @param flags DDRIVER_AIO_POOL强制使用线程池
+ * @return int 0成功，否则为错误号
+ */
+int ddriver_aio_setup(int fd, int depth, int flags) {
+    int i;
+    if (depth <= 0) {
+        return -EINVAL;
+    }
+    if (aio.depth != 0) {
+        ddriver_aio_destroy(aio.fd);
+    }
+    aio.fd        = fd;
+    aio.depth     = depth;
+    aio.inflight  = 0;
+    aio.use_uring = !(flags & DDRIVER_AIO_POOL) && uring_setup(depth) == 0;
+    if (aio.use_uring) {
+        return 0;
+    }
+
+    user_info("aio served by %d workers", CONFIG_AIO_WORKERS);
+    aio.pending = (struct ddriver_aio **)malloc(depth * sizeof(struct ddriver_aio *));
+    aio.done    = (struct ddriver_aio **)malloc(depth * sizeof(struct ddriver_aio *));
+    if (aio.pending == NULL || aio.done == NULL) {
+        free(aio.pending);
+        free(aio.done);
+        aio.depth = 0;
+        return -ENOMEM;
+    }
+    aio.pending_head = aio.pending_cnt = 0;
+    aio.done_head    = aio.done_cnt    = 0;
+    aio.stop         = FALSE;
+    for (i = 0; i < CONFIG_AIO_WORKERS; i++) {
+        pthread_create(&aio.workers[i], NULL, aio_worker, NULL);
+    }
+    return 0;
+}
+/**
+ * @brief 提交一批异步请求，不等待完成
+ * 
+ * @param fd 
+ * @param reqs 请求数组，完成前不得释放
+ * @param nr 
+ * @return int 实际提交的请求数（受队列深度限制），负数为错误号
+ */
+int ddriver_aio_submit(int fd, struct ddriver_aio *reqs, int nr) {
+    struct aio_uring *ring = &aio.ring;
+    struct io_uring_sqe *sqe;
+    unsigned tail, idx;
+    size_t size;
+    int i, ret;
+    IGNORE_ARG(fd);
+
+    if (aio.depth == 0) {
+        return -EINVAL;
+    }
+    for (i = 0; i < nr; i++) {
+        struct iovec iov = { .iov_base = reqs[i].buf, .iov_len = reqs[i].size };
+        if ((ret = check_valid_vec(&iov, 1, &size)) < 0) {
+            return ret;
+        }
+        if (!IS_ADDR_ALIGN(reqs[i].offset)) {
+            user_alert("offset %ld must be aligned to block size %d", 
+                        reqs[i].offset, disk.iounit_size);
+            return -EINVAL;
+        }
+    }
+    nr = nr < aio.depth - aio.inflight ? nr : aio.depth - aio.inflight;
+    if (nr <= 0) {
+        return 0;
+    }
+
+    if (!aio.use_uring) {
+        pthread_mutex_lock(&aio.lock);
+        for (i = 0; i < nr; i++) {
+            aio.pending[(aio.pending_head + aio.pending_cnt) % aio.depth] = &reqs[i];
+            aio.pending_cnt++;
+        }
+        aio.inflight += nr;
+        pthread_cond_broadcast(&aio.pending_cond);
+        pthread_mutex_unlock(&aio.lock);
+        return nr;
+    }
+
+    tail = *ring->sq_tail;
+    for (i = 0; i < nr; i++) {
+        idx = tail & *ring->sq_mask;
+        sqe = &ring->sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode    = reqs[i].op == DDRIVER_AIO_WRITE ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd        = aio.fd;
+        sqe->addr      = (unsigned long)reqs[i].buf;
+        sqe->len       = reqs[i].size;
+        sqe->off       = reqs[i].offset;
+        sqe->rw_flags  = reqs[i].op == DDRIVER_AIO_WRITE && (reqs[i].flags & DDRIVER_WRITE_FUA) 
+                         ? RWF_DSYNC : 0;
+        sqe->user_data = (unsigned long)&reqs[i];
+        ring->sq_array[idx] = idx;
+        tail++;
+    }
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+    ret = syscall(__NR_io_uring_enter, ring->ring_fd, nr, 0, 0, NULL, 0);
+    if (ret < 0) {
+        ret = -errno;
+        user_panic("io_uring_enter error: %s", strerror(-ret));
+        __atomic_store_n(ring->sq_tail, tail - nr, __ATOMIC_RELEASE);
+        return ret;
+    }
+    if (ret < nr) {                                  /* 内核只取走了前ret个，收回其余的SQE */
+        __atomic_store_n(ring->sq_tail, tail - (nr - ret), __ATOMIC_RELEASE);
+    }
+    emulate_batch(reqs, ret);                        /* 收回的请求重新提交时才计磁头移动与延迟 */
+    aio.inflight += ret;
+    return ret;
+}
+/**
+ * @brief 收割已完成的异步请求
+ * 
+ * @param fd 
+ * @param done 输出已完成请求的指针，通过tag/res区分
+ * @param min_nr 至少等待完成的请求数，超过在途数时按在途数计
+ * @param max_nr done数组容量
+ * @return int 收割的请求数，一个也未收割到且出错时为负的错误号
+ */
+int ddriver_aio_complete(int fd, struct ddriver_aio **done, int min_nr, int max_nr) {
+    struct aio_uring *ring = &aio.ring;
+    struct io_uring_cqe *cqe;
+    unsigned head;
+    int got = 0, err = 0;
+    IGNORE_ARG(fd);
+
+    if (aio.depth == 0) {
+        return -EINVAL;
+    }
+    min_nr = min_nr < aio.inflight ? min_nr : aio.inflight;
+    max_nr = max_nr < aio.inflight ? max_nr : aio.inflight;
+
+    if (!aio.use_uring) {
+        pthread_mutex_lock(&aio.lock);
+        while (aio.done_cnt < min_nr) {
+            pthread_cond_wait(&aio.done_cond, &aio.lock);
+        }
+        while (got < max_nr && aio.done_cnt > 0) {
+            done[got++] = aio.done[aio.done_head];
+            aio.done_head = (aio.done_head + 1) % aio.depth;
+            aio.done_cnt--;
+        }
+        aio.inflight -= got;
+        pthread_mutex_unlock(&aio.lock);
+        return got;
+    }
+
+    while (got < max_nr) {
+        head = *ring->cq_head;
+        if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            if (got >= min_nr) {
+                break;
+            }
+            if (syscall(__NR_io_uring_enter, ring->ring_fd, 0, min_nr - got, 
+                        IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+                err = -errno;
+                user_panic("io_uring_enter error: %s", strerror(-err));
+                break;
+            }
+            continue;
+        }
+        cqe = &ring->cqes[head & *ring->cq_mask];
+        done[got] = (struct ddriver_aio *)(unsigned long)cqe->user_data;
+        done[got]->res = cqe->res;
+        account_io(done[got]->op == DDRIVER_AIO_WRITE, done[got]->offset, 
+                   cqe->res > 0 ? cqe->res : 0, done[got]->submit_us);
+        got++;
+        __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    }
+    aio.inflight -= got;
+    return got > 0 ? got : err;
+}
+/**
+ * @brief 等待所有在途请求完成并释放异步IO队列，无法收割时放弃剩余请求，
+ *        关闭io_uring时内核会取消它们
+ * 
+ * @param fd 
+ * @return int 
+ */
+int ddriver_aio_destroy(int fd) {
+    struct ddriver_aio *req;
+    int i;
+    IGNORE_ARG(fd);
+
+    if (aio.depth == 0) {
+        return 0;
+    }
+    while (aio.inflight > 0) {
+        if (ddriver_aio_complete(aio.fd, &req, 1, 1) <= 0) {
+            user_alert("abort %d inflight aio requests", aio.inflight);
+            aio.inflight = 0;
+        }
+    }
+    if (aio.use_uring) {
+        uring_teardown();
+    }
+    else {
+        pthread_mutex_lock(&aio.lock);
+        aio.stop = TRUE;
+        pthread_cond_broadcast(&aio.pending_cond);
+        pthread_mutex_unlock(&aio.lock);
+        for (i = 0; i < CONFIG_AIO_WORKERS; i++) {
+            pthread_join(aio.workers[i], NULL);
+        }
+        free(aio.pending);
+        free(aio.done);
+    }
+    aio.depth = 0;
+    return 0;
 }
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "errno.h"
+#include <unistd.h>
+#include <pwd.h>
+#include <time.h>
+#include <stdint.h>
+#include "ddriver.h"
+
+/******************************************************************************
+* SECTION: Macro definitions
+*******************************************************************************/
+#define DEVICE_NAME   "ddriver"
+#define DEVICE_TRACE  "ddriver_trace"
+#define ENV_TRACE     "DDRIVER_TRACE"
+
+#define TRUE          1
+#define FALSE         0
+/******************************************************************************
+* SECTION: Helper Functions
+*******************************************************************************/
+void usage() {
+    printf("用法: ddriver_replay [options] [trace]\n");
+    printf("按trace重新向设备发起请求，默认trace为~/" DEVICE_TRACE "\n");
+    printf("options: \n");
+    printf("-t            按录制时的时间间隔发起请求，默认全速回放\n");
+    printf("-h            打印本帮助菜单\n");
+    printf("注意: 写请求会以全0数据覆盖设备对应区域\n");
+}
+
+uint64_t clock_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+/**
+ * @brief 打印扩展统计信息，延迟直方图只打印非空的桶
+ */
+void dump_stats(struct ddriver_stats *stats, uint64_t elapsed_us) {
+    uint64_t total = stats->seq_cnt + stats->rand_cnt;
+    int i;
+
+    printf("elapsed      %llu us\n", (unsigned long long)elapsed_us);
+    printf("read         %llu reqs, %llu bytes\n",
+           (unsigned long long)stats->read_cnt, (unsigned long long)stats->read_bytes);
+    printf("write        %llu reqs, %llu bytes\n",
+           (unsigned long long)stats->write_cnt, (unsigned long long)stats->write_bytes);
+    printf("seek         %llu reqs, %llu bytes\n",
+           (unsigned long long)stats->seek_cnt, (unsigned long long)stats->seek_dist);
+    printf("sequential   %.1f%%\n", total ? 100.0 * stats->seq_cnt / total : 0.0);
+    printf("latency(us)  read / write\n");
+    for (i = 0; i < DDRIVER_LAT_BUCKETS; i++) {
+        if (stats->read_lat_hist[i] == 0 && stats->write_lat_hist[i] == 0) {
+            continue;
+        }
+        printf("[%llu, %llu)  %llu / %llu\n",
+               i ? 1ULL << i : 0ULL, 1ULL << (i + 1),
+               (unsigned long long)stats->read_lat_hist[i],
+               (unsigned long long)stats->write_lat_hist[i]);
+    }
+}
+/******************************************************************************
+* SECTION: Main
+*******************************************************************************/
+int main(int argc, char *argv[]) {
+    char device_path[128] = {0};
+    char trace_path[128] = {0};
+    struct ddriver_trace_hdr hdr;
+    struct ddriver_trace_rec rec;
+    struct ddriver_stats stats;
+    FILE *tracef;
+    char *buf = NULL;
+    size_t buf_sz = 0;
+    uint64_t start, now, due;
+    int fd, opt, ret, block_sz;
+    int timing = FALSE, err_cnt = 0, rec_cnt = 0;
+
+    while ((opt = getopt(argc, argv, "th")) != -1) {
+        switch (opt) {
+        case 't':
+            timing = TRUE;
+            break;
+        default:
+            usage();
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    sprintf(device_path, "%s/" DEVICE_NAME, getpwuid(getuid())->pw_dir);
+    if (optind < argc) {
+        snprintf(trace_path, sizeof(trace_path), "%s", argv[optind]);
+    }
+    else {
+        sprintf(trace_path, "%s/" DEVICE_TRACE, getpwuid(getuid())->pw_dir);
+    }
+
+    tracef = fopen(trace_path, "r");
+    if (tracef == NULL) {
+        printf("can't open trace %s: %s\n", trace_path, strerror(errno));
+        return 1;
+    }
+    if (fread(&hdr, sizeof(struct ddriver_trace_hdr), 1, tracef) != 1
+        || hdr.magic != DDRIVER_TRACE_MAGIC || hdr.version != DDRIVER_TRACE_VERSION) {
+        printf("%s is not a ddriver trace\n", trace_path);
+        fclose(tracef);
+        return 1;
+    }
+
+    unsetenv(ENV_TRACE);                             /* 回放本身不再录制，避免覆盖输入 */
+    fd = ddriver_open(device_path);
+    if (fd < 0) {
+        fclose(tracef);
+        return 1;
+    }
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_IO_SZ, &block_sz);
+    if (block_sz != hdr.block_sz) {
+        printf("trace block size %u mismatch device %d, set DDRIVER_BLOCK_SZ\n",
+               hdr.block_sz, block_sz);
+        ddriver_close(fd);
+        fclose(tracef);
+        return 1;
+    }
+
+    start = clock_us();
+    while (fread(&rec, sizeof(struct ddriver_trace_rec), 1, tracef) == 1) {
+        rec_cnt++;
+        if (timing) {
+            due = start + rec.ts_us;
+            now = clock_us();
+            if (due > now) {
+                usleep(due - now);
+            }
+        }
+        if (rec.size > buf_sz) {
+            free(buf);
+            buf_sz = rec.size;
+            buf = calloc(1, buf_sz);
+            if (buf == NULL) {
+                printf("no memory for %u bytes\n", rec.size);
+                break;
+            }
+        }
+        switch (rec.op) {
+        case DDRIVER_TRACE_SEEK:
+            ret = ddriver_seek(fd, rec.offset, SEEK_SET);
+            break;
+        case DDRIVER_TRACE_WRITE:
+            memset(buf, 0, rec.size);
+            ret = ddriver_pwrite(fd, buf, rec.size, rec.offset);
+            break;
+        case DDRIVER_TRACE_READ:
+            ret = ddriver_pread(fd, buf, rec.size, rec.offset);
+            break;
+        case DDRIVER_TRACE_FLUSH:
+            ret = ddriver_ioctl(fd, IOC_REQ_DEVICE_FLUSH, NULL);
+            break;
+        default:
+            ret = -EINVAL;
+            break;
+        }
+        if (ret < 0) {
+            printf("record %d (op %u, offset %llu, size %u) failed: %s\n",
+                   rec_cnt, rec.op, (unsigned long long)rec.offset, rec.size, strerror(-ret));
+            err_cnt++;
+        }
+    }
+
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_STATS, &stats);
+    printf("replayed %d records from %s, %d failed\n", rec_cnt, trace_path, err_cnt);
+    dump_stats(&stats, clock_us() - start);
+
+    free(buf);
+    ddriver_close(fd);
+    fclose(tracef);
+    return err_cnt ? 1 : 0;
+}
@@ -3,11 +3,21 @@
 
 #include "ddriver_ctl_user.h"
 #include "stdio.h"
+#include <sys/uio.h>
 
 int ddriver_open(char *path);
 int ddriver_seek(int fd, off_t offset, int whence);
 int ddriver_write(int fd, char *buf, size_t size);
 int ddriver_read(int fd, char *buf, size_t size);
+int ddriver_writev(int fd, const struct iovec *iov, int iovcnt);
+int ddriver_readv(int fd, const struct iovec *iov, int iovcnt);
+int ddriver_pwrite(int fd, char *buf, size_t size, off_t offset);
+int ddriver_pwrite2(int fd, char *buf, size_t size, off_t offset, int flags);
+int ddriver_pread(int fd, char *buf, size_t size, off_t offset);
+int ddriver_aio_setup(int fd, int depth, int flags);
+int ddriver_aio_submit(int fd, struct ddriver_aio *reqs, int nr);
+int ddriver_aio_complete(int fd, struct ddriver_aio **done, int min_nr, int max_nr);
+int ddriver_aio_destroy(int fd);
 int ddriver_ioctl(int fd, unsigned long cmd, void *ret);
 int ddriver_close(int fd);
 
@@ -2,6 +2,8 @@
 #define _DDRIVER_CTL_H_
 
 #include <sys/ioctl.h>   
+#include <sys/types.h>
+#include <stdint.h>
 /******************************************************************************
 * SECTION: IO ctl protocol definitions
 *******************************************************************************/
@@ -13,9 +15,96 @@ struct ddriver_state
     int seek_cnt;
 };
 
+struct ddriver_geometry
+{
+    uint64_t disk_sz;
+    int      block_sz;
+    int      track_num;
+    int      read_lat;
+    int      write_lat;
+    int      seek_lat;
+};
+
+#define DDRIVER_LAT_BUCKETS     32
+
+struct ddriver_stats
+{
+    uint64_t read_cnt;
+    uint64_t write_cnt;
+    uint64_t seek_cnt;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    uint64_t seek_dist;
+    uint64_t seq_cnt;
+    uint64_t rand_cnt;
+    uint64_t read_lat_hist[DDRIVER_LAT_BUCKETS];
+    uint64_t write_lat_hist[DDRIVER_LAT_BUCKETS];
+};
+
+struct ddriver_discard
+{
+    uint64_t offset;
+    uint64_t len;
+};
+
 #define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, int)
 #define IOC_REQ_DEVICE_STATE    _IOR(IOC_MAGIC, 1, struct ddriver_state)
 #define IOC_REQ_DEVICE_RESET    _IO(IOC_MAGIC, 2)
 #define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, int)
+#define IOC_REQ_DEVICE_MMAP     _IOW(IOC_MAGIC, 4, int)
+#define IOC_REQ_DEVICE_FLUSH    _IO(IOC_MAGIC, 5)
+#define IOC_REQ_DEVICE_GEOMETRY _IOR(IOC_MAGIC, 6, struct ddriver_geometry)
+#define IOC_REQ_DEVICE_STATS    _IOR(IOC_MAGIC, 7, struct ddriver_stats)
+#define IOC_REQ_DEVICE_DISCARD  _IOW(IOC_MAGIC, 8, struct ddriver_discard)
+
+/******************************************************************************
+* SECTION: Async IO protocol definitions
+*******************************************************************************/
+#define DDRIVER_AIO_READ        0
+#define DDRIVER_AIO_WRITE       1
+
+#define DDRIVER_AIO_POOL        0x1
+
+#define DDRIVER_WRITE_FUA       0x1
+
+struct ddriver_aio
+{
+    int    op;
+    int    flags;
+    char   *buf;
+    size_t size;
+    off_t  offset;
+    void   *tag;
+    int    res;
+    uint64_t submit_us;
+};
+
+/******************************************************************************
+* SECTION: Trace format definitions
+*******************************************************************************/
+#define DDRIVER_TRACE_MAGIC     0x52544444
+#define DDRIVER_TRACE_VERSION   1
+
+#define DDRIVER_TRACE_READ      0
+#define DDRIVER_TRACE_WRITE     1
+#define DDRIVER_TRACE_SEEK      2
+#define DDRIVER_TRACE_FLUSH     3
+
+struct ddriver_trace_hdr
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t disk_sz;
+    uint32_t block_sz;
+    uint32_t reserved;
+};
+
+struct ddriver_trace_rec
+{
+    uint64_t ts_us;
+    uint64_t offset;
+    uint32_t size;
+    uint32_t op;
+};
 
 #endif
\ No newline at end of file
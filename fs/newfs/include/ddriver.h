@@ -3,6 +3,7 @@
 
 #include "ddriver_ctl_user.h"
 #include "stdio.h"
+#include <sys/uio.h>
 
 /**
  * @brief 打开ddriver设备
@@ -42,6 +43,99 @@ int ddriver_write(int fd, char *buf, size_t size);
  */
 int ddriver_read(int fd, char *buf, size_t size);
 
+/**
+ * @brief 多块写入，一次请求写入若干连续块，只计一次写延迟
+ * 
+ * @param fd ddriver设备handler
+ * @param iov 要写入的数据段，每段大小必须是设备IO单位的整数倍
+ * @param iovcnt 数据段个数
+ * @return int 写入的字节数，负数为错误号
+ */
+int ddriver_writev(int fd, const struct iovec *iov, int iovcnt);
+
+/**
+ * @brief 多块读出，一次请求读出若干连续块，只计一次读延迟
+ * 
+ * @param fd ddriver设备handler
+ * @param iov 要读出的数据段，每段大小必须是设备IO单位的整数倍
+ * @param iovcnt 数据段个数
+ * @return int 读出的字节数，负数为错误号
+ */
+int ddriver_readv(int fd, const struct iovec *iov, int iovcnt);
+
+/**
+ * @brief 定位写入，无需先ddriver_seek，可多线程并发调用
+ * 
+ * @param fd ddriver设备handler
+ * @param buf 要写入的数据Buf
+ * @param size 要写入的数据大小，必须是设备IO单位的整数倍
+ * @param offset 写入位置，注意要和设备IO单位对齐
+ * @return int 写入的字节数，负数为错误号
+ */
+int ddriver_pwrite(int fd, char *buf, size_t size, off_t offset);
+
+/**
+ * @brief 带标志的定位写入
+ * 
+ * @param fd ddriver设备handler
+ * @param buf 要写入的数据Buf
+ * @param size 要写入的数据大小，必须是设备IO单位的整数倍
+ * @param offset 写入位置，注意要和设备IO单位对齐
+ * @param flags DDRIVER_WRITE_FUA：返回前本次写入已持久化，否则填0
+ * @return int 写入的字节数，负数为错误号
+ */
+int ddriver_pwrite2(int fd, char *buf, size_t size, off_t offset, int flags);
+
+/**
+ * @brief 定位读出，无需先ddriver_seek，可多线程并发调用
+ * 
+ * @param fd ddriver设备handler
+ * @param buf 要读出的数据Buf
+ * @param size 要读出的数据大小，必须是设备IO单位的整数倍
+ * @param offset 读出位置，注意要和设备IO单位对齐
+ * @return int 读出的字节数，负数为错误号
+ */
+int ddriver_pread(int fd, char *buf, size_t size, off_t offset);
+
+/**
+ * @brief 初始化异步IO队列，优先使用io_uring，不可用时退化为线程池
+ * 
+ * @param fd ddriver设备handler
+ * @param depth 最多同时在途的请求数
+ * @param flags DDRIVER_AIO_POOL强制使用线程池，否则填0
+ * @return int 0成功，否则失败
+ */
+int ddriver_aio_setup(int fd, int depth, int flags);
+
+/**
+ * @brief 提交一批异步请求，不等待完成
+ * 
+ * @param fd ddriver设备handler
+ * @param reqs 请求数组，完成前不得释放
+ * @param nr 请求个数
+ * @return int 实际提交的请求数（受队列深度限制），负数为错误号
+ */
+int ddriver_aio_submit(int fd, struct ddriver_aio *reqs, int nr);
+
+/**
+ * @brief 收割已完成的异步请求
+ * 
+ * @param fd ddriver设备handler
+ * @param done 输出已完成请求的指针，通过tag和res获取结果
+ * @param min_nr 至少等待完成的请求数
+ * @param max_nr done数组容量
+ * @return int 收割的请求数，一个也未收割到且出错时为负的错误号
+ */
+int ddriver_aio_complete(int fd, struct ddriver_aio **done, int min_nr, int max_nr);
+
+/**
+ * @brief 等待在途请求完成并释放异步IO队列，ddriver_close时会自动调用
+ * 
+ * @param fd ddriver设备handler
+ * @return int 0成功，否则失败
+ */
+int ddriver_aio_destroy(int fd);
+
 /**
  * @brief ddriver IO控制
  * 
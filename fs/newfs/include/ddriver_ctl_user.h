@@ -2,6 +2,8 @@
 #define _DDRIVER_CTL_H_
 
 #include <sys/ioctl.h>   
+#include <sys/types.h>
+#include <stdint.h>
 /******************************************************************************
 * SECTION: IO ctl protocol definitions
 *******************************************************************************/
@@ -13,9 +15,96 @@ struct ddriver_state
     int seek_cnt;
 };
 
+struct ddriver_geometry
+{
+    uint64_t disk_sz;                                                       /* 磁盘大小 */
+    int      block_sz;                                                      /* 设备IO单位 */
+    int      track_num;                                                     /* 磁道数 */
+    int      read_lat;                                                      /* 读延迟，单位us */
+    int      write_lat;                                                     /* 写延迟，单位us */
+    int      seek_lat;                                                      /* 寻道转一圈的延迟，单位us */
+};
+
+#define DDRIVER_LAT_BUCKETS     32                                          /* 延迟直方图桶数 */
+
+struct ddriver_stats
+{
+    uint64_t read_cnt;                                                      /* 读请求数 */
+    uint64_t write_cnt;                                                     /* 写请求数 */
+    uint64_t seek_cnt;                                                      /* 寻道次数 */
+    uint64_t read_bytes;                                                    /* 读出字节数 */
+    uint64_t write_bytes;                                                   /* 写入字节数 */
+    uint64_t seek_dist;                                                     /* 累计寻道距离，单位字节 */
+    uint64_t seq_cnt;                                                       /* 紧接上次传输结束位置的请求数 */
+    uint64_t rand_cnt;                                                      /* 其余请求数，seq_cnt / (seq_cnt + rand_cnt)为顺序率 */
+    uint64_t read_lat_hist[DDRIVER_LAT_BUCKETS];                            /* 第i个桶统计耗时在[2^i, 2^(i+1)) us的读请求 */
+    uint64_t write_lat_hist[DDRIVER_LAT_BUCKETS];                           /* 同上，写请求 */
+};
+
+struct ddriver_discard                                                      /* 须与设备IO单位对齐 */
+{
+    uint64_t offset;
+    uint64_t len;
+};
+
 #define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, int)                     /* 请求查看设备大小 */
 #define IOC_REQ_DEVICE_STATE    _IOR(IOC_MAGIC, 1, struct ddriver_state)    /* 请求设备状态，返回 ddriver_state */
 #define IOC_REQ_DEVICE_RESET    _IO(IOC_MAGIC, 2)                           /* 请求重置设备 */
 #define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, int)                     /* 请求设备IO大小 */
+#define IOC_REQ_DEVICE_MMAP     _IOW(IOC_MAGIC, 4, int)                     /* 请求切换mmap后端，1开启，0关闭 */
+#define IOC_REQ_DEVICE_FLUSH    _IO(IOC_MAGIC, 5)                           /* 请求将缓存数据刷回磁盘 */
+#define IOC_REQ_DEVICE_GEOMETRY _IOR(IOC_MAGIC, 6, struct ddriver_geometry) /* 请求几何参数与延迟模型，返回 ddriver_geometry */
+#define IOC_REQ_DEVICE_STATS    _IOR(IOC_MAGIC, 7, struct ddriver_stats)    /* 请求扩展统计信息，返回 ddriver_stats */
+#define IOC_REQ_DEVICE_DISCARD  _IOW(IOC_MAGIC, 8, struct ddriver_discard)  /* 请求丢弃一段数据，之后读出为0 */
+
+/******************************************************************************
+* SECTION: Async IO protocol definitions
+*******************************************************************************/
+#define DDRIVER_AIO_READ        0                                           /* 异步读 */
+#define DDRIVER_AIO_WRITE       1                                           /* 异步写 */
+
+#define DDRIVER_AIO_POOL        0x1                                         /* 不使用io_uring，强制使用线程池 */
+
+#define DDRIVER_WRITE_FUA       0x1                                         /* 写请求完成时数据已持久化，无需再IOC_REQ_DEVICE_FLUSH */
+
+struct ddriver_aio
+{
+    int    op;                                                              /* DDRIVER_AIO_READ / DDRIVER_AIO_WRITE */
+    int    flags;                                                           /* 写请求可带DDRIVER_WRITE_FUA，否则填0 */
+    char   *buf;
+    size_t size;                                                            /* 必须是设备IO单位的整数倍 */
+    off_t  offset;                                                          /* 必须与设备IO单位对齐 */
+    void   *tag;                                                            /* 用户标签，完成时原样返回 */
+    int    res;                                                             /* 完成后为传输字节数，负数为错误号 */
+    uint64_t submit_us;                                                     /* 驱动内部使用 */
+};
+
+/******************************************************************************
+* SECTION: Trace format definitions
+*******************************************************************************/
+#define DDRIVER_TRACE_MAGIC     0x52544444                                  /* "DDTR" */
+#define DDRIVER_TRACE_VERSION   1
+
+#define DDRIVER_TRACE_READ      0                                           /* 读，offset与size为传输范围 */
+#define DDRIVER_TRACE_WRITE     1                                           /* 写，offset与size为传输范围 */
+#define DDRIVER_TRACE_SEEK      2                                           /* ddriver_seek，offset为目标位置，size为0 */
+#define DDRIVER_TRACE_FLUSH     3                                           /* IOC_REQ_DEVICE_FLUSH，offset与size为0 */
+
+struct ddriver_trace_hdr                                                    /* trace文件头，其后紧跟若干ddriver_trace_rec */
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t disk_sz;                                                       /* 录制时的磁盘大小 */
+    uint32_t block_sz;                                                      /* 录制时的设备IO单位 */
+    uint32_t reserved;
+};
+
+struct ddriver_trace_rec
+{
+    uint64_t ts_us;                                                         /* 请求发起时刻，相对设备打开时刻，单位us */
+    uint64_t offset;
+    uint32_t size;
+    uint32_t op;                                                            /* DDRIVER_TRACE_READ / WRITE / SEEK */
+};
 
 #endif
\ No newline at end of file
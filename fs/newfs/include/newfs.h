@@ -11,6 +11,7 @@
 #include <stddef.h>
 #include "ddriver.h"
 #include "errno.h"
+#include <pthread.h>
 #include "types.h"
 #include "stdint.h"
 
@@ -47,19 +48,85 @@ char* 			   get_name(const char* );
 int 			   calc_lvl(const char * );
 int 			   newfs_driver_read(int , uint8_t *, int );
 int 			   newfs_driver_write(int , uint8_t *, int );
-int                newfs_search_data_bitmap();
+int 			   newfs_driver_write_flags(int , uint8_t *, int , int );
+int 			   newfs_driver_flush();
+int 			   newfs_driver_batch(int , int *, uint8_t *, int );
+int 			   newfs_driver_discard(int , int );
+int                newfs_bitmap_init(struct newfs_bitmap *, uint32_t , int , int , int );
+void               newfs_bitmap_destroy(struct newfs_bitmap *);
+uint8_t*           newfs_bitmap_chunk(struct newfs_bitmap *, int );
+int                newfs_bitmap_alloc(struct newfs_bitmap *);
+int                newfs_bitmap_free(struct newfs_bitmap *, int );
+int                newfs_bitmap_sync(struct newfs_bitmap *);
+int                newfs_bitmap_alloc_at(struct newfs_bitmap *, int );
+int                newfs_search_data_bitmap(int );
+int                newfs_release_data_bitmap(int );
+int                newfs_release_data_blks(int *, int );
+
+int                newfs_sync_bitmaps();
 
 int 			   newfs_mount();
 int 			   newfs_umount();
 
+int 			   newfs_dir_blks(int );
 int 			   newfs_alloc_dentry(struct newfs_inode *, struct newfs_dentry *);
 int 			   newfs_drop_dentry(struct newfs_inode * , struct newfs_dentry *);
+int 			   newfs_dentry_hash_resize(struct newfs_inode *, int );
+struct newfs_dentry* newfs_find_dentry(struct newfs_inode *, const char *);
 struct newfs_inode*  newfs_alloc_inode(struct newfs_dentry *);
 int 			   newfs_sync_inode(struct newfs_inode * );
+int 			   newfs_write_inode(struct newfs_inode * );
+int 			   newfs_inode_io(struct newfs_inode *, int , uint8_t **, int , int , uint8_t *);
 int 			   newfs_drop_inode(struct newfs_inode * );
 struct newfs_inode*  newfs_read_inode(struct newfs_dentry * , int );
 struct newfs_dentry* newfs_get_dentry(struct newfs_inode *, int);
 
 struct newfs_dentry* newfs_lookup(const char * , int * , int* );
+/******************************************************************************
+* SECTION: newfs_map.c
+*******************************************************************************/
+int 			   newfs_map_max_blks();
+int 			   newfs_map_reserve(struct newfs_inode *, int );
+int 			   newfs_map_load(struct newfs_inode *, struct newfs_inode_d *);
+int 			   newfs_map_store(struct newfs_inode *, struct newfs_inode_d *, int );
+int 			   newfs_map_charge(struct newfs_inode *, int );
+int 			   newfs_map_release(struct newfs_inode *);
+/******************************************************************************
+* SECTION: newfs_page.c
+*******************************************************************************/
+int 			   newfs_page_reserve(struct newfs_inode *, int );
+int 			   newfs_page_fault(struct newfs_inode *, int , int );
+int 			   newfs_page_read(struct newfs_inode *, uint8_t *, int , int );
+int 			   newfs_page_write(struct newfs_inode *, const uint8_t *, int , int );
+int 			   newfs_page_truncate(struct newfs_inode *, int );
+void 			   newfs_page_release(struct newfs_inode *);
+void 			   newfs_page_shrink(struct newfs_inode *);
+void 			   newfs_mem_track(struct newfs_inode *);
+void 			   newfs_mem_touch(struct newfs_inode *);
+void 			   newfs_mem_forget(struct newfs_inode *);
+void 			   newfs_evict_inode(struct newfs_inode *);
+int 			   newfs_mem_reclaim();
+/******************************************************************************
+* SECTION: newfs_cache.c
+*******************************************************************************/
+int 			   newfs_cache_init();
+void 			   newfs_cache_destroy();
+int 			   newfs_cache_read(int , uint8_t *, int );
+int 			   newfs_cache_readthrough(int , uint8_t *, int );
+int 			   newfs_cache_write(int , uint8_t *, int , int );
+int 			   newfs_cache_writeback(int , int , int );
+void 			   newfs_cache_invalidate(int , int );
+int 			   newfs_cache_flush();
+/******************************************************************************
+* SECTION: newfs_writeback.c
+*******************************************************************************/
+int 			   newfs_writeback_init();
+void 			   newfs_writeback_exit();
+void 			   newfs_lock();
+int 			   newfs_unlock(int );
+void 			   newfs_mark_dirty(struct newfs_inode *, int , int );
+void 			   newfs_mark_dentry(struct newfs_inode *, struct newfs_dentry *);
+void 			   newfs_clean_inode(struct newfs_inode *);
+int 			   newfs_writeback(int );
 
 #endif  /* _newfs_H_ */
\ No newline at end of file
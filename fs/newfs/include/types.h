@@ -23,8 +23,21 @@ typedef enum fs_file_type {
 #define NEWFS_INODE_BITMAP_OFS    1
 #define NEWFS_DATA_BITMAP_OFS     2
 #define NEWFS_INODE_OFS           3
-#define NEWFS_DATA_BLK            6
+#define NEWFS_DATA_BLK            6     /* 旧格式每个inode的直接块指针数 */
+#define NEWFS_INLINE_EXTENTS      3     /* inode内联的extent数，其余放入溢出块 */
+#define NEWFS_VERSION_BLKPTR      0     /* 旧格式：直接块指针，文件最多NEWFS_DATA_BLK块 */
+#define NEWFS_VERSION_EXTENT      1     /* extent格式 */
+#define NEWFS_VERSION_INDIRECT    2     /* 直接块指针加一级、二级间接块 */
+#define NEWFS_DIRECT_BLK          5     /* 间接块格式下inode内的直接块指针数 */
 #define NEWFS_ROOT_INO            0
+#define NEWFS_AIO_DEPTH           16    /* 异步IO队列深度 */
+#define NEWFS_CACHE_BLKS          256   /* 块缓存容量，单位逻辑块 */
+#define NEWFS_CACHE_HASH          64    /* 块缓存哈希桶数，须为2的幂 */
+#define NEWFS_DIR_HASH            16    /* 目录哈希表的最少桶数，须为2的幂 */
+#define NEWFS_READAHEAD           8     /* 默认预读窗口上限，单位逻辑块 */
+#define NEWFS_DIRTY_EXPIRE        5000  /* 回写模式下脏inode的最长驻留时间，单位ms */
+#define NEWFS_DIRTY_BYTES         (256 * 1024) /* 回写模式下脏数据达到该值立即回写 */
+#define NEWFS_MEM_LIMIT           (16 * 1024 * 1024) /* 常驻的文件inode与数据页的默认上限 */
 /******************************************************************************
 * SECTION: Macro Function
 *******************************************************************************/
@@ -37,8 +50,24 @@ struct newfs_dentry;
 struct newfs_inode;
 struct newfs_super;
 
+struct newfs_bitmap {
+    uint32_t           offset;                        /* 位图区的设备偏移 */
+    int                blks;                          /* 位图占用的逻辑块数 */
+    int                nbits;                         /* 有效位数 */
+    uint8_t**          chunks;                        /* 每个逻辑块一段，首次访问时读入 */
+    uint8_t*           dirty;                         /* 每段是否需要写回 */
+    int                hint;                          /* 下次分配从该64位字开始扫描 */
+    int                free;
+};
+
 struct custom_options {
 	const char*        device;
+	int                readahead;     /* 预读窗口上限，单位逻辑块，0关闭预读 */
+	int                writeback;     /* 开启后台回写 */
+	int                dirty_expire;  /* 单位ms */
+	int                dirty_bytes;
+	int                indirect;      /* 格式化时使用NEWFS_VERSION_INDIRECT */
+	int                mem_limit;     /* 单位字节 */
 };
 
 struct newfs_super {
@@ -48,12 +77,12 @@ struct newfs_super {
     int                sz_disk;
     int                sz_logit;
     int                sz_usage;
-    //索引位图, 默认一块逻辑块
+    //索引位图, 按inode数量占用若干逻辑块
     uint32_t           inode_bitmap_offset;
-    uint8_t *          inodes_bitmap;
-    //数据块位图， 默认一块逻辑块
+    struct newfs_bitmap inode_map;
+    //数据块位图， 按数据块数量占用若干逻辑块
     uint32_t           data_bitmap_offset;
-    uint8_t*           data_bitmap;
+    struct newfs_bitmap data_map;
     //索引节点
     uint32_t           inode_blks; //索引块数， 
     uint32_t           blk_per_inode; // 每个逻辑块放多少inode
@@ -61,13 +90,46 @@ struct newfs_super {
 
     uint32_t           data_offset;
     uint32_t           data_blks;//数据块个数
+    uint32_t           version;   // 磁盘格式，决定inode中数据块映射的存放方式
 
     int            is_mounted;
 
     struct newfs_dentry* root_dentry;// 内存根目录
+
+    pthread_mutex_t    lock;                          /* 可重入，FUSE操作与回写线程互斥 */
+    struct newfs_inode* dirty_list;                   /* 脏inode链表 */
+    int                dirty_bytes;
+    pthread_t          flusher;
+    pthread_cond_t     flusher_cond;
+    int                flusher_stop;
+    int                wb_error;                      /* 后台回写的错误号，写回成功后清零 */
+
+    struct newfs_inode* lru_head;                     /* 常驻的文件inode，表头为最近使用 */
+    struct newfs_inode* lru_tail;
+    int                mem_bytes;                     /* 文件inode与数据页占用的内存 */
+    int                rsv_blks;                      /* 脏inode已预留、写回时才分配的块数 */
 };
 
 
+struct newfs_cache_blk {
+    int                offset;                        /* 设备偏移，按逻辑块对齐，-1为空闲 */
+    int                dirty;
+    uint8_t*           data;
+    struct newfs_cache_blk* hash_next;
+    struct newfs_cache_blk* lru_prev;
+    struct newfs_cache_blk* lru_next;
+};
+
+struct newfs_cache {
+    struct newfs_cache_blk*  blks;                    /* 固定大小的缓存块池 */
+    struct newfs_cache_blk*  hash[NEWFS_CACHE_HASH];
+    struct newfs_cache_blk   lru;                     /* 哨兵，lru_next为最近使用，lru_prev为淘汰候选 */
+    uint8_t*                 ra_buf;                  /* 多块读的暂存区，ra_max个逻辑块 */
+    int                      ra_max;
+    int                      ra_next;                 /* 顺序访问时下一个预期的块偏移 */
+    int                      ra_window;               /* 当前预读窗口，顺序命中时倍增 */
+};
+
 struct newfs_inode {
     uint32_t ino;
     /* TODO: Define yourself */
@@ -76,7 +138,25 @@ struct newfs_inode {
     int                dir_cnt;
     struct newfs_dentry* dentry;                        /* 指向该inode的dentry */
     struct newfs_dentry* dentrys;                       /* 所有目录项 */
-    uint8_t*           data;
+    struct newfs_dentry** dentry_hash;                  /* 目录项按名字哈希，桶数不少于目录项数 */
+    int                hash_size;
+    uint8_t**          pages;                         /* 第i页缓存文件的第i个逻辑块，NULL表示未读入 */
+    int                page_cap;
+    int                blk_valid;                     /* 前blk_valid个数据块在磁盘上的内容有效，其后缺页视为全0 */
+    int*               blks;                          /* 上次写回的数据块，第i项为第i个逻辑块的块号 */
+    uint8_t*           blk_dirty;                     /* 第i个数据块需要重写 */
+    int                blk_cnt;
+    int                blk_cap;                       /* blks与blk_dirty的容量 */
+    int*               meta_blks;                     /* 映射自身占用的块，如extent溢出块 */
+    int                meta_cnt;
+    int                map_stale;                     /* 上次写回映射中途失败，磁盘上的映射块需全部重写 */
+    int                rsv_blks;                      /* 为写回预留的数据块与映射块数 */
+    int                dirty;
+    int                dirty_bytes;
+    uint64_t           dirty_ms;                      /* 首次变脏的时刻 */
+    struct newfs_inode* dirty_next;
+    struct newfs_inode* lru_prev;
+    struct newfs_inode* lru_next;
 };
 
 struct newfs_dentry {
@@ -87,10 +167,23 @@ struct newfs_dentry {
     struct newfs_dentry*  parent;
     struct newfs_dentry*  brother;
     struct newfs_inode* inode;
+    uint32_t              hash;                         /* 名字的哈希值 */
+    struct newfs_dentry*  hash_next;
 };
 
+static inline uint32_t newfs_name_hash(const char * fname) {   /* FNV-1a */
+    uint32_t hash = 2166136261U;
+    while (*fname) {
+        hash = (hash ^ (uint8_t)*fname++) * 16777619U;
+    }
+    return hash;
+}
+
 static inline struct newfs_dentry* new_dentry(char * fname, FS_FILE_TYPE ftype) {
     struct newfs_dentry * dentry = (struct newfs_dentry *)malloc(sizeof(struct newfs_dentry));
+    if (dentry == NULL) {
+        return NULL;
+    }
     memset(dentry, 0, sizeof(struct newfs_dentry));
     memcpy(dentry->name, fname, strlen(fname));
     dentry->ftype   = ftype;
@@ -98,6 +191,8 @@ static inline struct newfs_dentry* new_dentry(char * fname, FS_FILE_TYPE ftype)
     dentry->inode   = NULL;
     dentry->parent  = NULL;
     dentry->brother = NULL; 
+    dentry->hash    = newfs_name_hash(dentry->name);
+    dentry->hash_next = NULL;
     return dentry;                                           
 }
 /******************************************************************************
@@ -118,6 +213,24 @@ struct newfs_super_d
     //数据块
     uint32_t           data_offset; // 数据块偏移
     uint32_t           data_blks;//数据块个数
+    uint32_t           inode_bitmap_blks; // 为0表示旧格式，位图各占一块
+    uint32_t           data_bitmap_blks;
+    uint32_t           inode_free;    // 卸载时记录，挂载时无需读入整个位图
+    uint32_t           data_free;
+    uint32_t           version;       // 旧镜像中为0，即NEWFS_VERSION_BLKPTR
+    uint32_t           clean;         // 正常卸载时置1，挂载后清0；为0时inode_free与data_free不可信
+};
+
+struct newfs_extent_d
+{
+    uint32_t           start;                         /* 起始数据块号 */
+    uint32_t           len;                           /* 连续块数，0表示未使用 */
+};
+
+struct newfs_extent_blk_d                             /* 溢出块头，其后紧跟cnt个extent */
+{
+    uint32_t           cnt;
+    int                next;                          /* 下一个溢出块，-1为末尾 */
 };
 
 struct newfs_inode_d// <= 200B
@@ -126,7 +239,18 @@ struct newfs_inode_d// <= 200B
     uint32_t           size;                          /* 文件已占用空间 */
     //char               target_path[MAX_NAME_LEN];/* store traget path when it is a symlink */
     uint32_t           dir_cnt;
-    int                block_pointer[NEWFS_DATA_BLK + 1];   // 数据块指针（可固定分配）
+    union {                                           /* 按super.version解释，两者同样大小 */
+        int            block_pointer[NEWFS_DATA_BLK + 1];   // 数据块指针（可固定分配）
+        struct {
+            struct newfs_extent_d extents[NEWFS_INLINE_EXTENTS];
+            int        extent_blk;                    /* 第一个溢出块，-1表示没有 */
+        };
+        struct {
+            int        direct[NEWFS_DIRECT_BLK];
+            int        indirect;                      /* 一级间接块，-1表示没有 */
+            int        dindirect;                     /* 二级间接块，其中每项指向一个一级间接块 */
+        };
+    };
     FS_FILE_TYPE       ftype;   
 };  
 
@@ -12,6 +12,12 @@
 *******************************************************************************/
 static const struct fuse_opt option_spec[] = {		/* 用于FUSE文件系统解析参数 */
 	OPTION("--device=%s", device),
+	OPTION("--readahead=%d", readahead),
+	OPTION("--writeback", writeback),
+	OPTION("--dirty_expire=%d", dirty_expire),
+	OPTION("--dirty_bytes=%d", dirty_bytes),
+	OPTION("--indirect", indirect),
+	OPTION("--mem_limit=%d", mem_limit),
 	FUSE_OPT_END
 };
 
@@ -87,6 +93,7 @@ void newfs_destroy(void* p) {
 int newfs_mkdir(const char* path, mode_t mode) {
 	/* TODO: 解析路径，创建目录 */
 	//(void *)mode;//忽略
+	newfs_lock();
 	int is_find, is_root;// ? is_root
 	char* filename;
 
@@ -94,20 +101,38 @@ int newfs_mkdir(const char* path, mode_t mode) {
 	struct newfs_dentry* dentry;
 	struct newfs_inode* inode;// ?
 
+	if (last_dentry == NULL) {
+		return newfs_unlock(-EIO);
+	}
 	if(is_find){
-		return -EEXIST;
+		return newfs_unlock(-EEXIST);
 	}
 
 	if(last_dentry->ftype == NEWFS_REG_FILE)
-		return -ENXIO;
+		return newfs_unlock(-ENXIO);
 	
 	filename = get_name(path);
 	dentry = new_dentry(filename, NEWFS_DIR);
+	if (dentry == NULL) {
+		return newfs_unlock(-ENOMEM);
+	}
 	dentry->parent = last_dentry;
 	inode = newfs_alloc_inode(dentry);
+	if (inode == NULL) {
+		free(dentry);
+		return newfs_unlock(-ENOSPC);
+	}
+	/* 父目录可能需要新的目录项块；放在inode分配之后，分配失败时父目录不留下预留 */
+	if (newfs_map_charge(last_dentry->inode, newfs_dir_blks(last_dentry->inode->dir_cnt + 1)) != 0) {
+		newfs_drop_inode(inode);
+		free(dentry);
+		return newfs_unlock(-ENOSPC);
+	}
 	newfs_alloc_dentry(last_dentry->inode, dentry);
+	newfs_mark_dirty(inode, 0, 0);
+	newfs_mark_dentry(last_dentry->inode, dentry);
 
-	return 0;
+	return newfs_unlock(0);
 }
 
 /**
@@ -119,10 +144,14 @@ int newfs_mkdir(const char* path, mode_t mode) {
  */
 int newfs_getattr(const char* path, struct stat * newfs_stat) {
 	/* TODO: 解析路径，获取Inode，填充newfs_stat，可参考/fs/simplefs/sfs.c的sfs_getattr()函数实现 */
+	newfs_lock();
 	int is_find, is_root;
 	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
+	if (dentry == NULL) {
+		return newfs_unlock(-EIO);
+	}
 	if(is_find == 0) {
-		return -ENOENT;
+		return newfs_unlock(-ENOENT);
 	}
 
 	if(dentry->ftype == NEWFS_DIR) {
@@ -149,7 +178,7 @@ int newfs_getattr(const char* path, struct stat * newfs_stat) {
 		newfs_stat->st_nlink  = 2;		/* !特殊，根目录link数为2 */
 	}
 
-	return 0;
+	return newfs_unlock(0);
 }
 
 /**
@@ -173,21 +202,25 @@ int newfs_getattr(const char* path, struct stat * newfs_stat) {
 int newfs_readdir(const char * path, void * buf, fuse_fill_dir_t filler, off_t offset,
 			    		 struct fuse_file_info * fi) {
     /* TODO: 解析路径，获取目录的Inode，并读取目录项，利用filler填充到buf，可参考/fs/simplefs/sfs.c的sfs_readdir()函数实现 */
+	newfs_lock();
 	int is_find, is_root;
 	int cur_dir = offset;
 
 	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
 	struct newfs_dentry* subentry;
 	struct newfs_inode* inode;
+	if (dentry == NULL) {
+		return newfs_unlock(-EIO);
+	}
 	if(is_find){
 		inode = dentry->inode;
 		subentry = newfs_get_dentry(inode, cur_dir);// change to filename
 		if(subentry){
 			filler(buf, subentry->name, NULL, ++offset);
 		}
-		return 0;
+		return newfs_unlock(0);
 	}
-    return -ENOENT;
+    return newfs_unlock(-ENOENT);
 }
 
 /**
@@ -200,6 +233,7 @@ int newfs_readdir(const char * path, void * buf, fuse_fill_dir_t filler, off_t o
  */
 int newfs_mknod(const char* path, mode_t mode, dev_t dev) {
 	/* TODO: 解析路径，并创建相应的文件 */
+	newfs_lock();
 	int is_find, is_root;
 
 	struct newfs_dentry* last_dentry = newfs_lookup(path, &is_find, &is_root);
@@ -207,8 +241,11 @@ int newfs_mknod(const char* path, mode_t mode, dev_t dev) {
 	struct newfs_inode* inode;
 	char* filename;
 
+	if (last_dentry == NULL) {
+		return newfs_unlock(-EIO);
+	}
 	if(is_find == TRUE){
-		return -EEXIST;
+		return newfs_unlock(-EEXIST);
 	}
 
 	filename = get_name(path);
@@ -223,11 +260,26 @@ int newfs_mknod(const char* path, mode_t mode, dev_t dev) {
 	else {
 		dentry = new_dentry(filename, NEWFS_REG_FILE);
 	}
+	if (dentry == NULL) {
+		return newfs_unlock(-ENOMEM);
+	}
 
 	dentry->parent = last_dentry;
 	inode = newfs_alloc_inode(dentry);
+	if (inode == NULL) {
+		free(dentry);
+		return newfs_unlock(-ENOSPC);
+	}
+	/* 同newfs_mkdir，inode分配成功后才为父目录预留 */
+	if (newfs_map_charge(last_dentry->inode, newfs_dir_blks(last_dentry->inode->dir_cnt + 1)) != 0) {
+		newfs_drop_inode(inode);
+		free(dentry);
+		return newfs_unlock(-ENOSPC);
+	}
 	newfs_alloc_dentry(last_dentry->inode, dentry);
-	return 0;
+	newfs_mark_dirty(inode, 0, 0);
+	newfs_mark_dentry(last_dentry->inode, dentry);
+	return newfs_unlock(0);
 }
 
 /**
@@ -257,30 +309,42 @@ int newfs_utimens(const char* path, const struct timespec tv[2]) {
 int newfs_write(const char* path, const char* buf, size_t size, off_t offset,
 		        struct fuse_file_info* fi) {
 	/* 选做 */
+	newfs_lock();
 	int is_find, is_root;
 	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
 	struct newfs_inode* inode;
 
+	if (dentry == NULL) {
+		return newfs_unlock(-EIO);
+	}
 	if(is_find == 0){
-		return -ENOENT;
+		return newfs_unlock(-ENOENT);
 	}
 
 	inode = dentry->inode;
 
 	if(inode->dentry->ftype == NEWFS_DIR){
-		return -EISDIR;
+		return newfs_unlock(-EISDIR);
+	}
+	if (super.wb_error != 0) {					/* 后台回写失败，见newfs_flusher */
+		return newfs_unlock(super.wb_error);
 	}
 
 	if (inode->size < offset) {
-		return -ESPIPE;
-	}else{
-		if(inode->size < offset + size){
-			inode->data = (uint8_t *)realloc(inode->data, offset + size);
-		}
+		return newfs_unlock(-ESPIPE);
+	}else if ((off_t)(offset + size) > (off_t)newfs_map_max_blks() * super.sz_logit) {
+		return newfs_unlock(-EFBIG);
+	}
+	if (newfs_map_charge(inode, ROUND_UP(offset + size > inode->size ? offset + size : inode->size, 
+	                                     super.sz_logit) / super.sz_logit) != 0) {
+		return newfs_unlock(-ENOSPC);
+	}
+	if (newfs_page_write(inode, (const uint8_t *)buf, offset, size) != 0) {
+		return newfs_unlock(-EIO);
 	}
-	memcpy(inode->data + offset, buf, size);
 	inode->size = offset + size > inode->size ? offset + size : inode->size;
-	return size;
+	newfs_mark_dirty(inode, offset, size);
+	return newfs_unlock(size);
 }
 
 /**
@@ -296,28 +360,34 @@ int newfs_write(const char* path, const char* buf, size_t size, off_t offset,
 int newfs_read(const char* path, char* buf, size_t size, off_t offset,
 		       struct fuse_file_info* fi) {
 	/* 选做 */
+	newfs_lock();
 	int is_find, is_root;
 	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
 	struct newfs_inode* inode;
+	if (dentry == NULL) {
+		return newfs_unlock(-EIO);
+	}
 	if(is_find == 0){
-		return -ENOENT;
+		return newfs_unlock(-ENOENT);
 	}
 
 	if(dentry->ftype == NEWFS_DIR){
-		return -EISDIR;
+		return newfs_unlock(-EISDIR);
 	}
 
 	inode = dentry->inode;
 
 	if(inode->size < offset){
-		return -ESPIPE;
+		return newfs_unlock(-ESPIPE);
 	}
 
 	if(inode->size < offset + size){
 		size = inode->size - offset;
 	}
-	memcpy(buf, inode->data + offset, size);
-	return size;			   
+	if (newfs_page_read(inode, (uint8_t *)buf, offset, size) != 0) {
+		return newfs_unlock(-EIO);
+	}
+	return newfs_unlock(size);			   
 }
 
 /**
@@ -328,19 +398,24 @@ int newfs_read(const char* path, char* buf, size_t size, off_t offset,
  */
 int newfs_unlink(const char* path) {
 	/* 选做 */
-	int is_find, is_root;
+	newfs_lock();
+	int is_find, is_root, ret;
 	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
 	struct newfs_inode* inode;
 
+	if (dentry == NULL) {
+		return newfs_unlock(-EIO);
+	}
 	if(is_find == 0){
-		return -ENOENT;
+		return newfs_unlock(-ENOENT);
 	}
 
 	inode = dentry->inode;
 
-	newfs_drop_inode(inode);
+	newfs_mark_dentry(dentry->parent->inode, dentry);
+	ret = newfs_drop_inode(inode);				/* 块已释放，只有丢弃可能出错 */
 	newfs_drop_dentry(dentry->parent->inode, dentry);
-	return 0;
+	return newfs_unlock(ret);
 }
 
 /**
@@ -357,8 +432,9 @@ int newfs_unlink(const char* path) {
  */
 int newfs_rmdir(const char* path) {
 	/* 选做 */
+	newfs_lock();
 	newfs_unlink(path);
-	return 0;
+	return newfs_unlock(0);
 }
 
 /**
@@ -370,6 +446,7 @@ int newfs_rmdir(const char* path) {
  */
 int newfs_rename(const char* from, const char* to) {
 	/* 选做 */
+	newfs_lock();
 	int ret = 0;
 	int is_find, is_root;
 	struct newfs_dentry* from_dentry = newfs_lookup(from, &is_find, &is_root);
@@ -377,12 +454,15 @@ int newfs_rename(const char* from, const char* to) {
 
 	mode_t mode = 0;
 
+	if (from_dentry == NULL) {
+		return newfs_unlock(-EIO);
+	}
 	if(is_find == 0){
-		return -ENOENT;
+		return newfs_unlock(-ENOENT);
 	}
 
 	if(strcmp(from, to) == 0){
-		return 0;
+		return newfs_unlock(0);
 	}
 
 	if(from_dentry->ftype == NEWFS_DIR){
@@ -393,15 +473,20 @@ int newfs_rename(const char* from, const char* to) {
 
 	ret = newfs_mknod(to, mode, NULL);
 	if(ret != 0){
-		return ret;
+		return newfs_unlock(ret);
 	}
 
 	to_dentry = newfs_lookup(to, &is_find, &is_root);
+	if (to_dentry == NULL) {
+		return newfs_unlock(-EIO);
+	}
 	newfs_drop_inode(to_dentry->inode);
 	to_dentry->ino = from_dentry->ino;
 	to_dentry->inode = from_dentry->inode;
+	to_dentry->inode->dentry = to_dentry;		/* inode被淘汰时经此清空dentry->inode */
+	newfs_mark_dentry(from_dentry->parent->inode, from_dentry);
 	newfs_drop_dentry(from_dentry->parent->inode, from_dentry);
-	return ret;
+	return newfs_unlock(ret);
 }
 
 /**
@@ -438,27 +523,43 @@ int newfs_opendir(const char* path, struct fuse_file_info* fi) {
  */
 int newfs_truncate(const char* path, off_t offset) {
 	/* 选做 */
+	newfs_lock();
 	int is_find, is_root;
 	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
 	struct newfs_inode* inode;
 
+	if (dentry == NULL) {
+		return newfs_unlock(-EIO);
+	}
 	if(is_find == 0){
-		return -ENOENT;
+		return newfs_unlock(-ENOENT);
 	}
 
 	if(dentry->ftype == NEWFS_DIR) {
-		return -EISDIR;
+		return newfs_unlock(-EISDIR);
 	}
 	inode = dentry->inode;
-	
+	if (super.wb_error != 0) {
+		return newfs_unlock(super.wb_error);
+	}
 
-	uint8_t * temp;
-	temp = (uint8_t *)malloc(offset);
-	memcpy(temp, inode->data, inode->size);
-	free(inode->data);
-	inode->data = temp;
+	if ((off_t)offset > (off_t)newfs_map_max_blks() * super.sz_logit) {
+		return newfs_unlock(-EFBIG);
+	}
+	if (newfs_map_charge(inode, ROUND_UP(offset, super.sz_logit) / super.sz_logit) != 0) {
+		return newfs_unlock(-ENOSPC);
+	}
+	if (newfs_page_truncate(inode, offset) != 0) {
+		return newfs_unlock(-EIO);
+	}
+	if (inode->size < offset) {					/* 扩展部分为0，需要写回 */
+		newfs_mark_dirty(inode, inode->size, offset - inode->size);
+	}
+	else {										/* 末尾页中被截掉的部分已清零，需要写回 */
+		newfs_mark_dirty(inode, offset, ROUND_UP(offset, super.sz_logit) - offset);
+	}
 	inode->size = offset;
-	return 0;
+	return newfs_unlock(0);
 }
 
 
@@ -476,11 +577,15 @@ int newfs_truncate(const char* path, off_t offset) {
  */
 int newfs_access(const char* path, int type) {
 	/* 选做: 解析路径，判断是否存在 */
+	newfs_lock();
 	int is_find, is_root;
 	int is_access_ok = 0;
 	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
 	struct newfs_inode* inode;
 
+	if (dentry == NULL) {
+		return newfs_unlock(-EIO);
+	}
 	switch(type)
 	{
 		case R_OK:
@@ -500,7 +605,7 @@ int newfs_access(const char* path, int type) {
 		default: 
 			break;
 	}
-	return is_access_ok ? 0 : -EACCES;
+	return newfs_unlock(is_access_ok ? 0 : -EACCES);
 }	
 /******************************************************************************
 * SECTION: FUSE入口
@@ -511,6 +616,12 @@ int main(int argc, char **argv)
 	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
 
 	newfs_options.device = strdup("~/user-land-filesystem/driver");
+	newfs_options.readahead = NEWFS_READAHEAD;
+	newfs_options.writeback = FALSE;
+	newfs_options.dirty_expire = NEWFS_DIRTY_EXPIRE;
+	newfs_options.dirty_bytes = NEWFS_DIRTY_BYTES;
+	newfs_options.indirect = FALSE;
+	newfs_options.mem_limit = NEWFS_MEM_LIMIT;
 
 	if (fuse_opt_parse(&args, &newfs_options, option_spec, NULL) == -1)
 		return -1;
@@ -0,0 +1,381 @@
+#include "newfs.h"
+
+extern struct newfs_super super;
+extern struct custom_options newfs_options;
+
+struct newfs_cache cache;
+
+#define CACHE_HASH(offset)      (((offset) / super.sz_logit) & (NEWFS_CACHE_HASH - 1))
+/**
+ * @brief 初始化块缓存，缓存块按逻辑块大小预先分配，全部挂在LRU链上
+ *
+ * @return int
+ */
+int newfs_cache_init() {
+    int i;
+    cache.blks = (struct newfs_cache_blk *)calloc(NEWFS_CACHE_BLKS, sizeof(struct newfs_cache_blk));
+    if (cache.blks == NULL) {
+        return -ENOMEM;
+    }
+    memset(cache.hash, 0, sizeof(cache.hash));
+    cache.lru.lru_prev = cache.lru.lru_next = &cache.lru;
+    cache.ra_max    = newfs_options.readahead;         /* 窗口不超过缓存的1/4，避免冲掉热块 */
+    cache.ra_max    = cache.ra_max < 0 ? 0 : cache.ra_max;
+    cache.ra_max    = cache.ra_max > NEWFS_CACHE_BLKS / 4 ? NEWFS_CACHE_BLKS / 4 : cache.ra_max;
+    cache.ra_next   = -1;
+    cache.ra_window = 0;
+    cache.ra_buf    = NULL;
+    if (cache.ra_max > 1) {
+        cache.ra_buf = (uint8_t *)malloc(cache.ra_max * super.sz_logit);
+        if (cache.ra_buf == NULL) {
+            free(cache.blks);
+            cache.blks = NULL;
+            return -ENOMEM;
+        }
+    }
+    for (i = 0; i < NEWFS_CACHE_BLKS; i++) {
+        cache.blks[i].offset = -1;
+        cache.blks[i].data = (uint8_t *)malloc(super.sz_logit);
+        if (cache.blks[i].data == NULL) {
+            newfs_cache_destroy();
+            return -ENOMEM;
+        }
+        cache.blks[i].lru_next = cache.lru.lru_next;
+        cache.blks[i].lru_prev = &cache.lru;
+        cache.lru.lru_next->lru_prev = &cache.blks[i];
+        cache.lru.lru_next = &cache.blks[i];
+    }
+    return 0;
+}
+/**
+ * @brief 释放块缓存，调用前应先newfs_cache_flush
+ */
+void newfs_cache_destroy() {
+    int i;
+    if (cache.blks == NULL) {
+        return;
+    }
+    for (i = 0; i < NEWFS_CACHE_BLKS; i++) {
+        free(cache.blks[i].data);
+    }
+    free(cache.blks);
+    free(cache.ra_buf);
+    cache.blks   = NULL;
+    cache.ra_buf = NULL;
+}
+/**
+ * @brief 在哈希链上查找缓存块
+ *
+ * @param offset 按逻辑块对齐的设备偏移
+ * @return struct newfs_cache_blk* 未命中返回NULL
+ */
+struct newfs_cache_blk* newfs_cache_lookup(int offset) {
+    struct newfs_cache_blk* blk = cache.hash[CACHE_HASH(offset)];
+    while (blk != NULL && blk->offset != offset) {
+        blk = blk->hash_next;
+    }
+    return blk;
+}
+/**
+ * @brief 将缓存块移到LRU链头
+ */
+void newfs_cache_touch(struct newfs_cache_blk* blk) {
+    blk->lru_prev->lru_next = blk->lru_next;
+    blk->lru_next->lru_prev = blk->lru_prev;
+    blk->lru_next = cache.lru.lru_next;
+    blk->lru_prev = &cache.lru;
+    cache.lru.lru_next->lru_prev = blk;
+    cache.lru.lru_next = blk;
+}
+/**
+ * @brief 将缓存块从哈希链上摘下，并放到LRU链尾优先复用
+ */
+void newfs_cache_unhash(struct newfs_cache_blk* blk) {
+    struct newfs_cache_blk** cursor = &cache.hash[CACHE_HASH(blk->offset)];
+    while (*cursor != blk) {
+        cursor = &(*cursor)->hash_next;
+    }
+    *cursor = blk->hash_next;
+    blk->offset = -1;
+    blk->dirty  = FALSE;
+
+    blk->lru_prev->lru_next = blk->lru_next;
+    blk->lru_next->lru_prev = blk->lru_prev;
+    blk->lru_prev = cache.lru.lru_prev;
+    blk->lru_next = &cache.lru;
+    cache.lru.lru_prev->lru_next = blk;
+    cache.lru.lru_prev = blk;
+}
+/**
+ * @brief 将一个脏块写回设备
+ *
+ * @param flags 传给ddriver_pwrite2，如DDRIVER_WRITE_FUA
+ * @return int
+ */
+int newfs_cache_writeblk(struct newfs_cache_blk* blk, int flags) {
+    if (ddriver_pwrite2(super.fd, (char *)blk->data, super.sz_logit,
+                        blk->offset, flags) != super.sz_logit) {
+        return -EIO;
+    }
+    blk->dirty = FALSE;
+    return 0;
+}
+/**
+ * @brief 未命中时从设备读入缓存块，块内[skip_lo, skip_hi)即将被整体覆盖，
+ *        完全落在其中的IO单位不必读入，只读头尾不完整的部分
+ *
+ * @return int
+ */
+int newfs_cache_fill(struct newfs_cache_blk* blk, int offset, int skip_lo, int skip_hi) {
+    int head = ROUND_UP(skip_lo, super.sz_io);      /* [0, head)须读入 */
+    int tail = ROUND_DOWN(skip_hi, super.sz_io);    /* [tail, sz_logit)须读入 */
+    if (head >= tail) {                             /* 未覆盖任何完整IO单位，整块读入 */
+        head = super.sz_logit;
+        tail = super.sz_logit;
+    }
+    if (head > 0 && ddriver_pread(super.fd, (char *)blk->data, head, offset) != head) {
+        return -EIO;
+    }
+    if (tail < super.sz_logit && ddriver_pread(super.fd, (char *)blk->data + tail, 
+                                               super.sz_logit - tail, 
+                                               offset + tail) != super.sz_logit - tail) {
+        return -EIO;
+    }
+    return 0;
+}
+/**
+ * @brief 获取offset处的缓存块，未命中时淘汰LRU链尾的块
+ *
+ * @param offset 按逻辑块对齐的设备偏移
+ * @param skip_lo 块内即将被覆盖写的起点，读时填0
+ * @param skip_hi 块内即将被覆盖写的终点，读时填0
+ * @return struct newfs_cache_blk* 出错返回NULL
+ */
+struct newfs_cache_blk* newfs_cache_get(int offset, int skip_lo, int skip_hi) {
+    struct newfs_cache_blk* blk = newfs_cache_lookup(offset);
+    if (blk != NULL) {
+        newfs_cache_touch(blk);
+        return blk;
+    }
+
+    blk = cache.lru.lru_prev;                       /* 淘汰最久未使用的块 */
+    if (blk->offset != -1) {
+        if (blk->dirty && newfs_cache_writeblk(blk, 0) != 0) {
+            return NULL;
+        }
+        newfs_cache_unhash(blk);
+    }
+    if (newfs_cache_fill(blk, offset, skip_lo, skip_hi) != 0) {
+        return NULL;
+    }
+    blk->offset    = offset;
+    blk->dirty     = FALSE;
+    blk->hash_next = cache.hash[CACHE_HASH(offset)];
+    cache.hash[CACHE_HASH(offset)] = blk;
+    newfs_cache_touch(blk);
+    return blk;
+}
+/**
+ * @brief 读offset处未命中的块时，把调用者要读的后续块和预读窗口合并为一次多块请求
+ *        读入缓存。紧接上次访问的未命中视为顺序访问，窗口倍增到ra_max；
+ *        否则窗口清零，只合并调用者本身要读的块
+ *
+ * @param offset 按逻辑块对齐的设备偏移
+ * @param want 调用者从offset起要读的块数
+ * @return int
+ */
+int newfs_cache_readahead(int offset, int want) {
+    struct newfs_cache_blk* blk;
+    int n, i;
+    if (offset == cache.ra_next) {
+        cache.ra_window = cache.ra_window ? cache.ra_window * 2 : 2;
+        cache.ra_window = cache.ra_window > cache.ra_max ? cache.ra_max : cache.ra_window;
+    }
+    else {
+        cache.ra_window = 0;
+    }
+    n = want > cache.ra_window ? want : cache.ra_window;
+    n = n > cache.ra_max ? cache.ra_max : n;
+    for (i = 1; i < n; i++) {                        /* 遇到已缓存的块或磁盘末尾即截断 */
+        if (offset + i * super.sz_logit >= super.sz_disk 
+            || newfs_cache_lookup(offset + i * super.sz_logit) != NULL) {
+            break;
+        }
+    }
+    n = i;
+    if (n <= 1) {                                    /* 单块交给newfs_cache_get读入 */
+        return 0;
+    }
+    if (ddriver_pread(super.fd, (char *)cache.ra_buf, n * super.sz_logit, 
+                      offset) != n * super.sz_logit) {
+        return -EIO;
+    }
+    for (i = 0; i < n; i++) {
+        if ((blk = newfs_cache_get(offset + i * super.sz_logit, 0, super.sz_logit)) == NULL) {
+            return -EIO;
+        }
+        memcpy(blk->data, cache.ra_buf + i * super.sz_logit, super.sz_logit);
+    }
+    return 0;
+}
+/**
+ * @brief 超出预读窗口的连续整块直接读入调用者的缓冲区，不占用缓存；
+ *        先写回范围内的脏块，保证设备上的内容是最新的
+ *
+ * @return int
+ */
+int newfs_cache_readthrough(int offset, uint8_t *out_content, int size) {
+    if (newfs_cache_writeback(offset, size, 0) != 0) {
+        return -EIO;
+    }
+    if (ddriver_pread(super.fd, (char *)out_content, size, offset) != size) {
+        return -EIO;
+    }
+    return 0;
+}
+/**
+ * @brief 经缓存读出任意范围，未命中时按newfs_cache_readahead合并读入，
+ *        大于预读窗口的对齐整块段按newfs_cache_readthrough直接读入
+ *
+ * @param offset
+ * @param out_content
+ * @param size
+ * @return int
+ */
+int newfs_cache_read(int offset, uint8_t *out_content, int size) {
+    struct newfs_cache_blk* blk;
+    int blk_offset, bias, len;
+    while (size > 0) {
+        blk_offset = ROUND_DOWN(offset, super.sz_logit);
+        bias = offset - blk_offset;
+        len  = super.sz_logit - bias < size ? super.sz_logit - bias : size;
+        if (bias == 0 && ROUND_DOWN(size, super.sz_logit) > super.sz_logit
+            && ROUND_DOWN(size, super.sz_logit) > cache.ra_max * super.sz_logit) {
+            len = ROUND_DOWN(size, super.sz_logit);
+            if (newfs_cache_readthrough(offset, out_content, len) != 0) {
+                return -EIO;
+            }
+            cache.ra_next = offset + len;
+            out_content += len;
+            offset += len;
+            size -= len;
+            continue;
+        }
+        if (newfs_cache_lookup(blk_offset) == NULL
+            && newfs_cache_readahead(blk_offset, ROUND_UP(bias + size, super.sz_logit) 
+                                                 / super.sz_logit) != 0) {
+            return -EIO;
+        }
+        if ((blk = newfs_cache_get(blk_offset, 0, 0)) == NULL) {
+            return -EIO;
+        }
+        memcpy(out_content, blk->data + bias, len);
+        cache.ra_next = blk_offset + super.sz_logit;
+        out_content += len;
+        offset += len;
+        size -= len;
+    }
+    return 0;
+}
+/**
+ * @brief 连续的整块直接从调用者的缓冲区一次写入设备，已缓存的副本同步更新
+ *
+ * @param flags 传给ddriver_pwrite2
+ * @return int
+ */
+int newfs_cache_writethrough(int offset, uint8_t *in_content, int size, int flags) {
+    struct newfs_cache_blk* blk;
+    int done;
+    if (ddriver_pwrite2(super.fd, (char *)in_content, size, offset, flags) != size) {
+        return -EIO;
+    }
+    for (done = 0; done < size; done += super.sz_logit) {
+        if ((blk = newfs_cache_lookup(offset + done)) != NULL) {
+            memcpy(blk->data, in_content + done, super.sz_logit);
+            blk->dirty = FALSE;
+        }
+    }
+    return 0;
+}
+/**
+ * @brief 经缓存写入任意范围，不完整的块只标记为脏，同一块上的多次小写入在内存中合并；
+ *        对齐的整块段绕过缓存直接写入
+ *
+ * @param offset
+ * @param in_content
+ * @param size
+ * @param flags 整块段写入时传给ddriver_pwrite2
+ * @return int
+ */
+int newfs_cache_write(int offset, uint8_t *in_content, int size, int flags) {
+    struct newfs_cache_blk* blk;
+    int blk_offset, bias, len;
+    while (size > 0) {
+        blk_offset = ROUND_DOWN(offset, super.sz_logit);
+        bias = offset - blk_offset;
+        len  = super.sz_logit - bias < size ? super.sz_logit - bias : size;
+        if (bias == 0 && size >= super.sz_logit) {
+            len = ROUND_DOWN(size, super.sz_logit);
+            if (newfs_cache_writethrough(offset, in_content, len, flags) != 0) {
+                return -EIO;
+            }
+        }
+        else {
+            if ((blk = newfs_cache_get(blk_offset, bias, bias + len)) == NULL) {
+                return -EIO;
+            }
+            memcpy(blk->data + bias, in_content, len);
+            blk->dirty = TRUE;
+        }
+        in_content += len;
+        offset += len;
+        size -= len;
+    }
+    return 0;
+}
+/**
+ * @brief 写回范围内的脏块，写回后仍保留在缓存中
+ *
+ * @param flags 传给ddriver_pwrite2
+ * @return int
+ */
+int newfs_cache_writeback(int offset, int size, int flags) {
+    struct newfs_cache_blk* blk;
+    int blk_offset;
+    for (blk_offset = ROUND_DOWN(offset, super.sz_logit); blk_offset < offset + size;
+         blk_offset += super.sz_logit) {
+        blk = newfs_cache_lookup(blk_offset);
+        if (blk != NULL && blk->dirty && newfs_cache_writeblk(blk, flags) != 0) {
+            return -EIO;
+        }
+    }
+    return 0;
+}
+/**
+ * @brief 丢弃范围内的缓存块（包括脏块），用于设备内容被绕过缓存改写时
+ */
+void newfs_cache_invalidate(int offset, int size) {
+    struct newfs_cache_blk* blk;
+    int blk_offset;
+    for (blk_offset = ROUND_DOWN(offset, super.sz_logit); blk_offset < offset + size;
+         blk_offset += super.sz_logit) {
+        if ((blk = newfs_cache_lookup(blk_offset)) != NULL) {
+            newfs_cache_unhash(blk);
+        }
+    }
+}
+/**
+ * @brief 写回全部脏块
+ *
+ * @return int
+ */
+int newfs_cache_flush() {
+    int i;
+    for (i = 0; i < NEWFS_CACHE_BLKS; i++) {
+        if (cache.blks[i].offset != -1 && cache.blks[i].dirty
+            && newfs_cache_writeblk(&cache.blks[i], 0) != 0) {
+            return -EIO;
+        }
+    }
+    return 0;
+}
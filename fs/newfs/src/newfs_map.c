@@ -0,0 +1,448 @@
+#include "newfs.h"
+#include <limits.h>
+
+extern struct newfs_super super;
+
+/* 每个溢出块在块头之后能放下的extent数 */
+#define EXTENTS_PER_BLK   ((int)((super.sz_logit - sizeof(struct newfs_extent_blk_d)) \
+                                 / sizeof(struct newfs_extent_d)))
+/* 每个间接块能放下的块指针数 */
+#define PTRS_PER_BLK      ((int)(super.sz_logit / sizeof(int)))
+
+/**
+ * @brief 当前磁盘格式下一个inode最多映射的数据块数
+ *
+ * @return int
+ */
+int newfs_map_max_blks() {
+    if (super.version == NEWFS_VERSION_BLKPTR) {
+        return NEWFS_DATA_BLK;
+    }
+    if (super.version == NEWFS_VERSION_INDIRECT) {
+        return NEWFS_DIRECT_BLK + PTRS_PER_BLK + PTRS_PER_BLK * PTRS_PER_BLK;
+    }
+    return INT_MAX;
+}
+/**
+ * @brief 保证blks与blk_dirty至少能容纳cnt项，新增部分不标记为脏
+ *
+ * @return int
+ */
+int newfs_map_reserve(struct newfs_inode* inode, int cnt) {
+    int*     blks;
+    uint8_t* blk_dirty;
+    int      cap = inode->blk_cap ? inode->blk_cap : NEWFS_DATA_BLK;
+    if (cnt <= inode->blk_cap) {
+        return 0;
+    }
+    while (cap < cnt) {
+        cap *= 2;
+    }
+    if ((blks = (int *)realloc(inode->blks, cap * sizeof(int))) == NULL) {
+        return -ENOMEM;
+    }
+    inode->blks = blks;
+    if ((blk_dirty = (uint8_t *)realloc(inode->blk_dirty, cap)) == NULL) {
+        return -ENOMEM;
+    }
+    memset(blk_dirty + inode->blk_cap, 0, cap - inode->blk_cap);
+    inode->blk_dirty = blk_dirty;
+    inode->blk_cap   = cap;
+    return 0;
+}
+/**
+ * @brief 在映射末尾追加从start起的len个连续数据块
+ *
+ * @return int
+ */
+static int newfs_map_push(struct newfs_inode* inode, int start, int len) {
+    int i;
+    if (newfs_map_reserve(inode, inode->blk_cnt + len) != 0) {
+        return -ENOMEM;
+    }
+    for (i = 0; i < len; i++) {
+        inode->blks[inode->blk_cnt++] = start + i;
+    }
+    return 0;
+}
+/**
+ * @brief 记录读入映射时经过的一个映射自身占用的块
+ *
+ * @return int
+ */
+static int newfs_map_push_meta(struct newfs_inode* inode, int blk) {
+    int* meta_blks;
+    if ((meta_blks = (int *)realloc(inode->meta_blks, (inode->meta_cnt + 1) * sizeof(int))) == NULL) {
+        return -ENOMEM;
+    }
+    inode->meta_blks = meta_blks;
+    inode->meta_blks[inode->meta_cnt++] = blk;
+    return 0;
+}
+/**
+ * @brief 调整映射自身占用的块数，多余的释放，不足的分配
+ *
+ * @return int
+ */
+static int newfs_map_meta(struct newfs_inode* inode, int cnt) {
+    int* meta_blks;
+    int  blk, ret;
+    if (inode->meta_cnt > cnt) {
+        ret = newfs_release_data_blks(inode->meta_blks + cnt, inode->meta_cnt - cnt);
+        inode->meta_cnt = cnt;
+        return ret;
+    }
+    if (inode->meta_cnt == cnt) {
+        return 0;
+    }
+    if ((meta_blks = (int *)realloc(inode->meta_blks, cnt * sizeof(int))) == NULL) {
+        return -ENOMEM;
+    }
+    inode->meta_blks = meta_blks;
+    while (inode->meta_cnt < cnt) {
+        blk = inode->meta_cnt ? inode->meta_blks[inode->meta_cnt - 1] + 1 : -1;
+        if ((blk = newfs_search_data_bitmap(blk)) < 0) {
+            return -ENOSPC;
+        }
+        inode->meta_blks[inode->meta_cnt++] = blk;
+    }
+    return 0;
+}
+/**
+ * @brief 读出extent格式的映射：先展开内联extent，再沿溢出块链逐块展开
+ *
+ * @return int
+ */
+static int newfs_extent_load(struct newfs_inode* inode, struct newfs_inode_d* inode_d) {
+    struct newfs_extent_blk_d hdr;
+    struct newfs_extent_d*    exts;
+    uint8_t* buf;
+    int      blk = inode_d->extent_blk, i;
+    for (i = 0; i < NEWFS_INLINE_EXTENTS && inode_d->extents[i].len != 0; i++) {
+        if (newfs_map_push(inode, inode_d->extents[i].start, inode_d->extents[i].len) != 0) {
+            return -ENOMEM;
+        }
+    }
+    if ((buf = (uint8_t *)malloc(super.sz_logit)) == NULL) {
+        return -ENOMEM;
+    }
+    while (blk != -1) {
+        if (newfs_driver_read(super.data_offset + blk * super.sz_logit, buf, super.sz_logit) != 0) {
+            free(buf);
+            return -EIO;
+        }
+        memcpy(&hdr, buf, sizeof(hdr));
+        if (hdr.cnt > (uint32_t)EXTENTS_PER_BLK) {
+            free(buf);
+            return -EIO;
+        }
+        if (newfs_map_push_meta(inode, blk) != 0) {
+            free(buf);
+            return -ENOMEM;
+        }
+        exts = (struct newfs_extent_d *)(buf + sizeof(hdr));
+        for (i = 0; i < (int)hdr.cnt; i++) {
+            if (newfs_map_push(inode, exts[i].start, exts[i].len) != 0) {
+                free(buf);
+                return -ENOMEM;
+            }
+        }
+        blk = hdr.next;
+    }
+    free(buf);
+    return 0;
+}
+/**
+ * @brief 将映射压缩为extent：前NEWFS_INLINE_EXTENTS个放在inode内，
+ *        其余依次写入溢出块，溢出块按需增减；映射未变时不重写溢出块
+ *
+ * @return int
+ */
+static int newfs_extent_store(struct newfs_inode* inode, struct newfs_inode_d* inode_d, int old_cnt) {
+    struct newfs_extent_blk_d hdr;
+    struct newfs_extent_d*    exts;
+    uint8_t* buf;
+    int      ext_cnt = 0, per_blk = EXTENTS_PER_BLK, i, ret;
+    exts = (struct newfs_extent_d *)malloc((inode->blk_cnt ? inode->blk_cnt : 1)
+                                           * sizeof(struct newfs_extent_d));
+    if (exts == NULL) {
+        return -ENOMEM;
+    }
+    for (i = 0; i < inode->blk_cnt; i++) {
+        if (ext_cnt > 0 && exts[ext_cnt - 1].start + exts[ext_cnt - 1].len == (uint32_t)inode->blks[i]) {
+            exts[ext_cnt - 1].len++;
+            continue;
+        }
+        exts[ext_cnt].start = inode->blks[i];
+        exts[ext_cnt].len   = 1;
+        ext_cnt++;
+    }
+    memset(inode_d->extents, 0, sizeof(inode_d->extents));
+    memcpy(inode_d->extents, exts,
+           (ext_cnt < NEWFS_INLINE_EXTENTS ? ext_cnt : NEWFS_INLINE_EXTENTS) * sizeof(struct newfs_extent_d));
+    ext_cnt = ext_cnt > NEWFS_INLINE_EXTENTS ? ext_cnt - NEWFS_INLINE_EXTENTS : 0;
+    inode_d->extent_blk = inode->meta_cnt ? inode->meta_blks[0] : -1;
+    if (old_cnt == inode->blk_cnt && !inode->map_stale
+        && inode->meta_cnt == ROUND_UP(ext_cnt, per_blk) / per_blk) {   /* 已有的块只会原地重写，溢出块不变 */
+        free(exts);
+        return 0;
+    }
+    if ((ret = newfs_map_meta(inode, ROUND_UP(ext_cnt, per_blk) / per_blk)) != 0) {
+        free(exts);
+        return ret;
+    }
+    if ((buf = (uint8_t *)calloc(1, super.sz_logit)) == NULL) {
+        free(exts);
+        return -ENOMEM;
+    }
+    for (i = 0; i < inode->meta_cnt; i++) {
+        hdr.cnt  = ext_cnt - i * per_blk < per_blk ? ext_cnt - i * per_blk : per_blk;
+        hdr.next = i + 1 < inode->meta_cnt ? inode->meta_blks[i + 1] : -1;
+        memcpy(buf, &hdr, sizeof(hdr));
+        memcpy(buf + sizeof(hdr), exts + NEWFS_INLINE_EXTENTS + i * per_blk,
+               hdr.cnt * sizeof(struct newfs_extent_d));
+        if (newfs_driver_write(super.data_offset + inode->meta_blks[i] * super.sz_logit,
+                               buf, super.sz_logit) != 0) {
+            free(buf);
+            free(exts);
+            return -EIO;
+        }
+    }
+    inode_d->extent_blk = inode->meta_cnt ? inode->meta_blks[0] : -1;   /* 溢出块可能新增或释放 */
+    free(buf);
+    free(exts);
+    return 0;
+}
+/**
+ * @brief 读入一个间接块，依次追加其中的块指针，遇到-1为止
+ *
+ * @return int
+ */
+static int newfs_indirect_load_blk(struct newfs_inode* inode, int blk, int* ptrs) {
+    int i;
+    if (newfs_driver_read(super.data_offset + blk * super.sz_logit, (uint8_t *)ptrs, super.sz_logit) != 0) {
+        return -EIO;
+    }
+    if (newfs_map_push_meta(inode, blk) != 0) {
+        return -ENOMEM;
+    }
+    for (i = 0; i < PTRS_PER_BLK && ptrs[i] != -1; i++) {
+        if (newfs_map_push(inode, ptrs[i], 1) != 0) {
+            return -ENOMEM;
+        }
+    }
+    return 0;
+}
+/**
+ * @brief 读出间接块格式的映射。meta_blks依次为一级间接块、二级间接块
+ *        和二级间接块指向的各一级间接块
+ *
+ * @return int
+ */
+static int newfs_indirect_load(struct newfs_inode* inode, struct newfs_inode_d* inode_d) {
+    int* top  = (int *)malloc(super.sz_logit);
+    int* ptrs = (int *)malloc(super.sz_logit);
+    int  i, ret = 0;
+    if (top == NULL || ptrs == NULL) {
+        ret = -ENOMEM;
+    }
+    for (i = 0; i < NEWFS_DIRECT_BLK && inode_d->direct[i] != -1 && ret == 0; i++) {
+        ret = newfs_map_push(inode, inode_d->direct[i], 1);
+    }
+    if (ret == 0 && inode_d->indirect != -1) {
+        ret = newfs_indirect_load_blk(inode, inode_d->indirect, ptrs);
+    }
+    if (ret == 0 && inode_d->dindirect != -1) {
+        if (newfs_driver_read(super.data_offset + inode_d->dindirect * super.sz_logit,
+                              (uint8_t *)top, super.sz_logit) != 0) {
+            ret = -EIO;
+        }
+        else {
+            ret = newfs_map_push_meta(inode, inode_d->dindirect);
+        }
+        for (i = 0; ret == 0 && i < PTRS_PER_BLK && top[i] != -1; i++) {
+            ret = newfs_indirect_load_blk(inode, top[i], ptrs);
+        }
+    }
+    free(top);
+    free(ptrs);
+    return ret;
+}
+/**
+ * @brief 映射自身需要的间接块数：一级间接块、二级间接块及其下的一级间接块
+ */
+static int newfs_indirect_meta_cnt(int blk_cnt) {
+    int rest = blk_cnt - NEWFS_DIRECT_BLK - PTRS_PER_BLK;
+    if (blk_cnt <= NEWFS_DIRECT_BLK) {
+        return 0;
+    }
+    if (rest <= 0) {
+        return 1;
+    }
+    return 2 + ROUND_UP(rest, PTRS_PER_BLK) / PTRS_PER_BLK;
+}
+/**
+ * @brief 写出一个一级间接块，保存第first个逻辑块起的PTRS_PER_BLK个块指针
+ *
+ * @return int
+ */
+static int newfs_indirect_write_blk(struct newfs_inode* inode, int blk, int first, int* ptrs) {
+    int i;
+    for (i = 0; i < PTRS_PER_BLK; i++) {
+        ptrs[i] = first + i < inode->blk_cnt ? inode->blks[first + i] : -1;
+    }
+    return newfs_driver_write(super.data_offset + blk * super.sz_logit, (uint8_t *)ptrs, super.sz_logit);
+}
+/**
+ * @brief 写出间接块格式的映射。已有的块只会原地重写，映射的变化总在
+ *        [min(old_cnt, blk_cnt), max(old_cnt, blk_cnt))内，只重写覆盖这一范围的间接块。
+ *        上次写回中途失败时间接块可能已被改写，全部重写
+ *
+ * @return int
+ */
+static int newfs_indirect_store(struct newfs_inode* inode, struct newfs_inode_d* inode_d, int old_cnt) {
+    int  full = inode->map_stale || inode->meta_cnt != newfs_indirect_meta_cnt(old_cnt);
+    int  lo = full ? 0 : old_cnt < inode->blk_cnt ? old_cnt : inode->blk_cnt;
+    int  hi = full ? inode->blk_cnt : old_cnt < inode->blk_cnt ? inode->blk_cnt : old_cnt;
+    int  first = NEWFS_DIRECT_BLK + PTRS_PER_BLK;    /* 二级间接块管理的第一个逻辑块 */
+    int  old_l2 = full ? -1 : newfs_indirect_meta_cnt(old_cnt) - 2;
+    int* ptrs;
+    int  i, ret = 0;
+    for (i = 0; i < NEWFS_DIRECT_BLK; i++) {
+        inode_d->direct[i] = i < inode->blk_cnt ? inode->blks[i] : -1;
+    }
+    if ((lo != hi || full) && (ret = newfs_map_meta(inode, newfs_indirect_meta_cnt(inode->blk_cnt))) != 0) {
+        return ret;
+    }
+    inode_d->indirect  = inode->meta_cnt > 0 ? inode->meta_blks[0] : -1;
+    inode_d->dindirect = inode->meta_cnt > 1 ? inode->meta_blks[1] : -1;
+    if (lo == hi && !full) {
+        return 0;
+    }
+    if ((ptrs = (int *)malloc(super.sz_logit)) == NULL) {
+        return -ENOMEM;
+    }
+    if (inode->meta_cnt > 0 && lo < first && hi > NEWFS_DIRECT_BLK) {
+        ret = newfs_indirect_write_blk(inode, inode->meta_blks[0], NEWFS_DIRECT_BLK, ptrs);
+    }
+    for (i = 2; ret == 0 && i < inode->meta_cnt; i++) {
+        if (lo < first + (i - 1) * PTRS_PER_BLK && hi > first + (i - 2) * PTRS_PER_BLK) {
+            ret = newfs_indirect_write_blk(inode, inode->meta_blks[i], 
+                                           first + (i - 2) * PTRS_PER_BLK, ptrs);
+        }
+    }
+    if (ret == 0 && inode->meta_cnt > 1 && inode->meta_cnt - 2 != old_l2) {
+        for (i = 0; i < PTRS_PER_BLK; i++) {           /* 一级间接块增减时才重写二级间接块 */
+            ptrs[i] = i + 2 < inode->meta_cnt ? inode->meta_blks[i + 2] : -1;
+        }
+        ret = newfs_driver_write(super.data_offset + inode->meta_blks[1] * super.sz_logit,
+                                 (uint8_t *)ptrs, super.sz_logit);
+    }
+    free(ptrs);
+    return ret != 0 ? -EIO : 0;
+}
+/**
+ * @brief 从磁盘inode读出数据块映射，填入inode->blks
+ *
+ * @return int
+ */
+int newfs_map_load(struct newfs_inode* inode, struct newfs_inode_d* inode_d) {
+    int i;
+    inode->blk_cnt  = 0;
+    inode->meta_cnt = 0;
+    if (super.version == NEWFS_VERSION_EXTENT) {
+        return newfs_extent_load(inode, inode_d);
+    }
+    if (super.version == NEWFS_VERSION_INDIRECT) {
+        return newfs_indirect_load(inode, inode_d);
+    }
+    for (i = 0; i < NEWFS_DATA_BLK && inode_d->block_pointer[i] != -1; i++) {
+        if (newfs_map_push(inode, inode_d->block_pointer[i], 1) != 0) {
+            return -ENOMEM;
+        }
+    }
+    return 0;
+}
+/**
+ * @brief 映射cnt个数据块时映射自身最多占用的块数，extent按每块各成一段估计
+ */
+static int newfs_map_meta_need(int cnt) {
+    if (super.version == NEWFS_VERSION_EXTENT) {
+        return cnt > NEWFS_INLINE_EXTENTS 
+               ? ROUND_UP(cnt - NEWFS_INLINE_EXTENTS, EXTENTS_PER_BLK) / EXTENTS_PER_BLK : 0;
+    }
+    if (super.version == NEWFS_VERSION_INDIRECT) {
+        return newfs_indirect_meta_cnt(cnt);
+    }
+    return 0;
+}
+/**
+ * @brief inode映射cnt个数据块时还需分配的块数
+ */
+static int newfs_map_need(struct newfs_inode* inode, int cnt) {
+    int need = cnt + newfs_map_meta_need(cnt) - inode->blk_cnt - inode->meta_cnt;
+    return need > 0 ? need : 0;
+}
+/**
+ * @brief inode将映射cnt个数据块，为写回时才分配的数据块与映射块预留空间。
+ *        块在写回时才分配，不预留则写入成功而写回因空间不足失败。
+ *        空间不足时先写回全部脏inode，把按最坏情况预留的映射块换成实际分配的再判断
+ *
+ * @return int 空间不足返回-ENOSPC，预留不变
+ */
+int newfs_map_charge(struct newfs_inode* inode, int cnt) {
+    int need = newfs_map_need(inode, cnt);
+    if (need > inode->rsv_blks && super.rsv_blks > 0
+        && need - inode->rsv_blks > super.data_map.free - super.rsv_blks) {
+        newfs_writeback(TRUE);
+        need = newfs_map_need(inode, cnt);
+    }
+    if (need > inode->rsv_blks 
+        && need - inode->rsv_blks > super.data_map.free - super.rsv_blks) {
+        return -ENOSPC;
+    }
+    super.rsv_blks += need - inode->rsv_blks;
+    inode->rsv_blks = need;
+    return 0;
+}
+/**
+ * @brief 将inode->blks写入磁盘inode，必要时写映射自身占用的块
+ *
+ * @param old_cnt 本次写回前已映射的块数，此前的块号不变
+ * @return int
+ */
+int newfs_map_store(struct newfs_inode* inode, struct newfs_inode_d* inode_d, int old_cnt) {
+    int i;
+    if (super.version == NEWFS_VERSION_EXTENT) {
+        return newfs_extent_store(inode, inode_d, old_cnt);
+    }
+    if (super.version == NEWFS_VERSION_INDIRECT) {
+        return newfs_indirect_store(inode, inode_d, old_cnt);
+    }
+    for (i = 0; i < inode->blk_cnt; i++) {                /* blk_cnt不超过newfs_map_max_blks() */
+        inode_d->block_pointer[i] = inode->blks[i];
+    }
+    inode_d->block_pointer[i] = -1;
+    return 0;
+}
+/**
+ * @brief 删除inode时释放全部数据块和映射自身占用的块，物理连续的块合并丢弃
+ *
+ * @return int 丢弃出错时的错误号，块总会被释放
+ */
+int newfs_map_release(struct newfs_inode* inode) {
+    int ret = newfs_release_data_blks(inode->blks, inode->blk_cnt);
+    int err = newfs_release_data_blks(inode->meta_blks, inode->meta_cnt);
+    free(inode->blks);
+    free(inode->blk_dirty);
+    free(inode->meta_blks);
+    super.rsv_blks  -= inode->rsv_blks;
+    inode->rsv_blks  = 0;
+    inode->blks      = NULL;
+    inode->blk_dirty = NULL;
+    inode->meta_blks = NULL;
+    inode->blk_cnt   = 0;
+    inode->blk_cap   = 0;
+    inode->meta_cnt  = 0;
+    return ret ? ret : err;
+}
@@ -0,0 +1,294 @@
+#include "newfs.h"
+
+extern struct newfs_super super;
+extern struct custom_options newfs_options;
+
+/**
+ * @brief 保证页数组至少能容纳cnt页，新增部分为未读入
+ *
+ * @return int
+ */
+int newfs_page_reserve(struct newfs_inode* inode, int cnt) {
+    uint8_t** pages;
+    int       cap = inode->page_cap ? inode->page_cap : NEWFS_DATA_BLK;
+    if (cnt <= inode->page_cap) {
+        return 0;
+    }
+    while (cap < cnt) {
+        cap *= 2;
+    }
+    if ((pages = (uint8_t **)realloc(inode->pages, cap * sizeof(uint8_t *))) == NULL) {
+        return -ENOMEM;
+    }
+    memset(pages + inode->page_cap, 0, (cap - inode->page_cap) * sizeof(uint8_t *));
+    inode->pages    = pages;
+    inode->page_cap = cap;
+    return 0;
+}
+/**
+ * @brief 使第[lo, hi)页全部驻留。缺页中磁盘内容有效的按newfs_inode_io读入，
+ *        物理连续的合并为一次请求，其余缺页置0；文件末尾之后的字节总为0
+ *
+ * @return int
+ */
+int newfs_page_fault(struct newfs_inode* inode, int lo, int hi) {
+    uint8_t* select;
+    int      valid = hi < inode->blk_valid ? hi : inode->blk_valid;
+    int      need = FALSE, eof, i, ret = 0;
+    if (newfs_page_reserve(inode, hi) != 0) {
+        return -ENOMEM;
+    }
+    if ((select = (uint8_t *)calloc(hi ? hi : 1, 1)) == NULL) {
+        return -ENOMEM;
+    }
+    for (i = lo; i < hi; i++) {
+        if (inode->pages[i] != NULL) {
+            continue;
+        }
+        if ((inode->pages[i] = (uint8_t *)calloc(1, super.sz_logit)) == NULL) {
+            free(select);
+            return -ENOMEM;
+        }
+        super.mem_bytes += super.sz_logit;
+        if (i < valid) {
+            select[i] = TRUE;
+            need      = TRUE;
+        }
+    }
+    if (need) {
+        ret = newfs_inode_io(inode, DDRIVER_AIO_READ, inode->pages, lo, valid, select);
+        eof = inode->size / super.sz_logit;
+        if (ret == 0 && eof < valid && select[eof]) {  /* 磁盘上末尾块的剩余部分可能是旧数据 */
+            memset(inode->pages[eof] + inode->size % super.sz_logit, 0,
+                   super.sz_logit - inode->size % super.sz_logit);
+        }
+    }
+    free(select);
+    return ret;
+}
+/**
+ * @brief 读出文件的[offset, offset + size)，调用者保证不超出文件大小
+ *
+ * @return int
+ */
+int newfs_page_read(struct newfs_inode* inode, uint8_t* out_content, int offset, int size) {
+    int page, bias, len;
+    if (size <= 0) {
+        return 0;
+    }
+    if (newfs_page_fault(inode, offset / super.sz_logit,
+                         ROUND_UP(offset + size, super.sz_logit) / super.sz_logit) != 0) {
+        return -EIO;
+    }
+    while (size > 0) {
+        page = offset / super.sz_logit;
+        bias = offset % super.sz_logit;
+        len  = super.sz_logit - bias < size ? super.sz_logit - bias : size;
+        memcpy(out_content, inode->pages[page] + bias, len);
+        out_content += len;
+        offset += len;
+        size -= len;
+    }
+    return 0;
+}
+/**
+ * @brief 写入文件的[offset, offset + size)，只有头尾不完整的页需要先读入，
+ *        整页覆盖的页直接分配；不修改inode->size
+ *
+ * @return int
+ */
+int newfs_page_write(struct newfs_inode* inode, const uint8_t* in_content, int offset, int size) {
+    int lo = offset / super.sz_logit;
+    int hi = ROUND_UP(offset + size, super.sz_logit) / super.sz_logit;
+    int page, bias, len;
+    if (size <= 0) {
+        return 0;
+    }
+    if (newfs_page_reserve(inode, hi) != 0) {
+        return -ENOMEM;
+    }
+    if (offset % super.sz_logit != 0 && newfs_page_fault(inode, lo, lo + 1) != 0) {
+        return -EIO;
+    }
+    if ((offset + size) % super.sz_logit != 0 && newfs_page_fault(inode, hi - 1, hi) != 0) {
+        return -EIO;
+    }
+    while (size > 0) {
+        page = offset / super.sz_logit;
+        bias = offset % super.sz_logit;
+        len  = super.sz_logit - bias < size ? super.sz_logit - bias : size;
+        if (inode->pages[page] == NULL) {
+            if ((inode->pages[page] = (uint8_t *)malloc(super.sz_logit)) == NULL) {
+                return -ENOMEM;
+            }
+            super.mem_bytes += super.sz_logit;
+        }
+        memcpy(inode->pages[page] + bias, in_content, len);
+        in_content += len;
+        offset += len;
+        size -= len;
+    }
+    return 0;
+}
+/**
+ * @brief 文件大小改为size前调整页：新旧大小中较小者所在的页清零其后部分，
+ *        缩小时释放多余的页，这些块在磁盘上的旧内容不再有效
+ *
+ * @return int
+ */
+int newfs_page_truncate(struct newfs_inode* inode, int size) {
+    int keep = size < (int)inode->size ? size : (int)inode->size;
+    int cnt  = ROUND_UP(size, super.sz_logit) / super.sz_logit;
+    int i;
+    if (keep % super.sz_logit != 0) {
+        if (newfs_page_fault(inode, keep / super.sz_logit, keep / super.sz_logit + 1) != 0) {
+            return -EIO;
+        }
+        memset(inode->pages[keep / super.sz_logit] + keep % super.sz_logit, 0,
+               super.sz_logit - keep % super.sz_logit);
+    }
+    if (size >= (int)inode->size) {
+        return 0;
+    }
+    for (i = cnt; i < inode->page_cap; i++) {
+        if (inode->pages[i] != NULL) {
+            free(inode->pages[i]);
+            inode->pages[i] = NULL;
+            super.mem_bytes -= super.sz_logit;
+        }
+    }
+    if (inode->blk_valid > cnt) {
+        inode->blk_valid = cnt;
+    }
+    return 0;
+}
+/**
+ * @brief 释放inode的全部页
+ */
+void newfs_page_release(struct newfs_inode* inode) {
+    int i;
+    for (i = 0; i < inode->page_cap; i++) {
+        if (inode->pages[i] != NULL) {
+            free(inode->pages[i]);
+            super.mem_bytes -= super.sz_logit;
+        }
+    }
+    free(inode->pages);
+    inode->pages    = NULL;
+    inode->page_cap = 0;
+}
+/**
+ * @brief 释放磁盘上已有最新内容的页，之后访问时重新读入
+ */
+void newfs_page_shrink(struct newfs_inode* inode) {
+    int valid = inode->blk_valid < inode->page_cap ? inode->blk_valid : inode->page_cap;
+    int i;
+    for (i = 0; i < valid; i++) {
+        if (inode->pages[i] != NULL && !inode->blk_dirty[i]) {
+            free(inode->pages[i]);
+            inode->pages[i] = NULL;
+            super.mem_bytes -= super.sz_logit;
+        }
+    }
+}
+/**
+ * @brief 文件inode读入或新建后挂到LRU表头并计入内存；目录inode构成目录树骨架，不参与淘汰
+ */
+void newfs_mem_track(struct newfs_inode* inode) {
+    inode->lru_prev = NULL;
+    inode->lru_next = NULL;
+    if (inode->dentry->ftype != NEWFS_REG_FILE) {
+        return;
+    }
+    inode->lru_next = super.lru_head;
+    if (super.lru_head != NULL) {
+        super.lru_head->lru_prev = inode;
+    }
+    super.lru_head = inode;
+    if (super.lru_tail == NULL) {
+        super.lru_tail = inode;
+    }
+    super.mem_bytes += sizeof(struct newfs_inode);
+}
+/**
+ * @brief 文件inode删除或淘汰时从LRU摘下
+ */
+void newfs_mem_forget(struct newfs_inode* inode) {
+    if (inode->dentry->ftype != NEWFS_REG_FILE) {
+        return;
+    }
+    if (inode->lru_prev != NULL) {
+        inode->lru_prev->lru_next = inode->lru_next;
+    }
+    else {
+        super.lru_head = inode->lru_next;
+    }
+    if (inode->lru_next != NULL) {
+        inode->lru_next->lru_prev = inode->lru_prev;
+    }
+    else {
+        super.lru_tail = inode->lru_prev;
+    }
+    inode->lru_prev = NULL;
+    inode->lru_next = NULL;
+    super.mem_bytes -= sizeof(struct newfs_inode);
+}
+/**
+ * @brief 访问文件inode时移到LRU表头
+ */
+void newfs_mem_touch(struct newfs_inode* inode) {
+    if (inode->dentry->ftype != NEWFS_REG_FILE || super.lru_head == inode) {
+        return;
+    }
+    newfs_mem_forget(inode);
+    newfs_mem_track(inode);
+}
+/**
+ * @brief 淘汰一个干净的文件inode，只保留dentry，下次访问时由newfs_read_inode重新读入
+ */
+void newfs_evict_inode(struct newfs_inode* inode) {
+    newfs_mem_forget(inode);
+    newfs_page_release(inode);
+    free(inode->blks);
+    free(inode->blk_dirty);
+    free(inode->meta_blks);
+    inode->dentry->inode = NULL;
+    free(inode);
+}
+/**
+ * @brief 从LRU表尾起释放干净的页，干净的inode整个淘汰，直到回到mem_limit以内
+ */
+static void newfs_mem_shrink() {
+    struct newfs_inode* inode;
+    struct newfs_inode* prev;
+    for (inode = super.lru_tail; inode != NULL && super.mem_bytes > newfs_options.mem_limit; inode = prev) {
+        prev = inode->lru_prev;
+        if (inode->dirty) {
+            newfs_page_shrink(inode);
+        }
+        else {
+            newfs_evict_inode(inode);
+        }
+    }
+}
+/**
+ * @brief 超出mem_limit时回收内存，只回收干净的部分仍然超出时先写回全部脏inode。
+ *        只能在没有操作持有inode指针时调用，见newfs_unlock
+ *
+ * @return int 写回的返回值，未写回时为0
+ */
+int newfs_mem_reclaim() {
+    int ret;
+    if (super.mem_bytes <= newfs_options.mem_limit) {
+        return 0;
+    }
+    newfs_mem_shrink();
+    if (super.mem_bytes <= newfs_options.mem_limit || super.dirty_list == NULL) {
+        return 0;
+    }
+    if ((ret = newfs_writeback(TRUE)) < 0) {          /* 写回失败的inode仍是脏的，不能淘汰 */
+        return ret;
+    }
+    newfs_mem_shrink();
+    return ret;
+}
@@ -37,7 +37,7 @@ int calc_lvl(const char * path){
     return lvl;
 }
 /**
- * @brief 驱动读
+ * @brief 驱动读，经块缓存
  * 
  * @param offset 
  * @param out_content 
@@ -45,25 +45,10 @@ int calc_lvl(const char * path){
  * @return int 
  */
 int newfs_driver_read(int offset, uint8_t *out_content, int size) {
-    int offset_align = ROUND_DOWN(offset, super.sz_io);
-    int bias = offset - offset_align;
-    int size_aligned = ROUND_UP((size + bias), super.sz_io);
-
-    uint8_t *temp_content = (uint8_t *)malloc(size_aligned);
-    uint8_t *cur = temp_content;
-
-    ddriver_seek(super.fd, offset_align, 0);
-    while (size_aligned != 0) {
-        ddriver_read(super.fd, cur, super.sz_io);
-        cur += super.sz_io;
-        size_aligned -= super.sz_io;
-    }
-    memcpy(out_content, temp_content + bias, size);
-    free(temp_content);
-    return 0;
+    return newfs_cache_read(offset, out_content, size);
 }
 /**
- * @brief 驱动写
+ * @brief 驱动写，经块缓存，脏块在淘汰或newfs_driver_flush时写回
  * 
  * @param offset 
  * @param in_content 
@@ -71,24 +56,159 @@ int newfs_driver_read(int offset, uint8_t *out_content, int size) {
  * @return int 
  */
 int newfs_driver_write(int offset, uint8_t *in_content, int size) {
-    int offset_aligned = ROUND_DOWN(offset, super.sz_io);
-    int bias = offset - offset_aligned;
-    int size_aligned = ROUND_UP((size + bias), super.sz_io);
-
-    uint8_t* temp_content = (uint8_t*)malloc(size_aligned);
-    uint8_t* cur = temp_content;
-    newfs_driver_read(offset_aligned, temp_content, size_aligned);
-    memcpy(temp_content + bias, in_content, size);
-
-    ddriver_seek(super.fd, offset_aligned, 0);
-    while(size_aligned != 0) {
-        ddriver_write(super.fd, (char*)cur, super.sz_io);
-        cur += super.sz_io;
-        size_aligned -= super.sz_io;
-    }
-    free(temp_content);
+    return newfs_driver_write_flags(offset, in_content, size, 0);
+}
+/**
+ * @brief 带标志的驱动写
+ * 
+ * @param flags DDRIVER_WRITE_FUA：返回前已持久化，用于提交超级块
+ * @return int 
+ */
+int newfs_driver_write_flags(int offset, uint8_t *in_content, int size, int flags) {
+    if (newfs_cache_write(offset, in_content, size, flags) != 0) {
+        return -EIO;
+    }
+    if (flags & DDRIVER_WRITE_FUA) {                 /* FUA写穿缓存 */
+        return newfs_cache_writeback(offset, size, flags);
+    }
+    return 0;
+}
+/**
+ * @brief 驱动刷写，此前完成的写入全部持久化后返回
+ * 
+ * @return int 
+ */
+int newfs_driver_flush() {
+    if (newfs_cache_flush() != 0) {
+        return -EIO;
+    }
+    if (ddriver_ioctl(super.fd, IOC_REQ_DEVICE_FLUSH, NULL) != 0) {
+        return -EIO;
+    }
+    return 0;
+}
+/**
+ * @brief 驱动丢弃，通知设备一段逻辑块已不再使用，之后读出为0
+ * 
+ * @param offset 须与IO单位对齐
+ * @param size 须为IO单位的整数倍
+ * @return int 
+ */
+int newfs_driver_discard(int offset, int size) {
+    struct ddriver_discard range = { .offset = offset, .len = size };
+    newfs_cache_invalidate(offset, size);
+    if (ddriver_ioctl(super.fd, IOC_REQ_DEVICE_DISCARD, &range) != 0) {
+        return -EIO;
+    }
+    return 0;
+}
+/**
+ * @brief 驱动批量读写，若干逻辑块同时在途，全部完成后返回
+ * 
+ * @param op DDRIVER_AIO_READ / DDRIVER_AIO_WRITE
+ * @param blk_offsets 每个逻辑块的设备偏移
+ * @param content 连续存放的blk_cnt个逻辑块
+ * @param blk_cnt 
+ * @return int 
+ */
+int newfs_driver_batch(int op, int *blk_offsets, uint8_t *content, int blk_cnt) {
+    struct ddriver_aio* reqs = (struct ddriver_aio*)malloc((blk_cnt ? blk_cnt : 1) * sizeof(struct ddriver_aio));
+    struct ddriver_aio* done[NEWFS_AIO_DEPTH];
+    int submitted = 0, completed = 0, ret = 0;
+    int i, cnt;
+
+    for (i = 0; i < blk_cnt; i++) {
+        reqs[i].op     = op;
+        reqs[i].flags  = 0;
+        reqs[i].buf    = (char *)(content + i * super.sz_logit);
+        reqs[i].size   = super.sz_logit;
+        reqs[i].offset = blk_offsets[i];
+        reqs[i].tag    = NULL;
+        if (op == DDRIVER_AIO_WRITE) {                /* 批量IO绕过块缓存，先保持一致 */
+            newfs_cache_invalidate(blk_offsets[i], super.sz_logit);
+        }
+        else if (newfs_cache_writeback(blk_offsets[i], super.sz_logit, 0) != 0) {
+            free(reqs);
+            return -EIO;
+        }
+    }
+    while (completed < blk_cnt) {
+        if (submitted < blk_cnt) {
+            cnt = ddriver_aio_submit(super.fd, reqs + submitted, blk_cnt - submitted);
+            if (cnt < 0) {                            /* 不再提交，收割已在途的请求 */
+                ret = -EIO;
+                blk_cnt = submitted;
+                continue;
+            }
+            submitted += cnt;
+        }
+        cnt = ddriver_aio_complete(super.fd, done, 1, NEWFS_AIO_DEPTH);
+        if (cnt <= 0) {                               /* 无法再收割，放弃剩余请求 */
+            ret = -EIO;
+            break;
+        }
+        for (i = 0; i < cnt; i++) {
+            if (done[i]->res != super.sz_logit) {
+                ret = -EIO;
+            }
+        }
+        completed += cnt;
+    }
+    free(reqs);
+    return ret;
+}
+/**
+ * @brief 重建目录的哈希表，桶数取不少于cnt的2的幂，至少NEWFS_DIR_HASH
+ * 
+ * @return int 
+ */
+int newfs_dentry_hash_resize(struct newfs_inode* inode, int cnt) {
+    struct newfs_dentry** table;
+    struct newfs_dentry*  dentry_cursor;
+    int size = NEWFS_DIR_HASH;
+    while (size < cnt) {
+        size *= 2;
+    }
+    if ((table = (struct newfs_dentry **)calloc(size, sizeof(struct newfs_dentry *))) == NULL) {
+        return -ENOMEM;
+    }
+    for (dentry_cursor = inode->dentrys; dentry_cursor != NULL; dentry_cursor = dentry_cursor->brother) {
+        dentry_cursor->hash_next = table[dentry_cursor->hash & (size - 1)];
+        table[dentry_cursor->hash & (size - 1)] = dentry_cursor;
+    }
+    free(inode->dentry_hash);
+    inode->dentry_hash = table;
+    inode->hash_size   = size;
     return 0;
 }
+/**
+ * @brief 在目录中按名字查找子dentry
+ * 
+ * @return struct newfs_dentry* 未找到返回NULL
+ */
+struct newfs_dentry* newfs_find_dentry(struct newfs_inode* inode, const char* fname) {
+    struct newfs_dentry* dentry_cursor;
+    uint32_t hash = newfs_name_hash(fname);
+    if (inode->dentry_hash == NULL) {
+        return NULL;
+    }
+    for (dentry_cursor = inode->dentry_hash[hash & (inode->hash_size - 1)]; dentry_cursor != NULL;
+         dentry_cursor = dentry_cursor->hash_next) {
+        if (dentry_cursor->hash == hash && strncmp(dentry_cursor->name, fname, MAX_NAME_LEN) == 0) {
+            return dentry_cursor;
+        }
+    }
+    return NULL;
+}
+/**
+ * @brief 存放dir_cnt个目录项需要的块数，目录项不跨块
+ * 
+ * @return int 
+ */
+int newfs_dir_blks(int dir_cnt) {
+    int dentry_per_blk = super.sz_logit / sizeof(struct newfs_dentry_d);
+    return ROUND_UP(dir_cnt, dentry_per_blk) / dentry_per_blk;
+}
 /**
  * @brief 将denry插入到inode中，采用头插法
  * 
@@ -105,6 +225,13 @@ int newfs_alloc_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
         inode->dentrys = dentry;
     }
     inode->dir_cnt++;
+    if (inode->dir_cnt > inode->hash_size && newfs_dentry_hash_resize(inode, inode->dir_cnt) == 0) {
+        /* 桶数倍增，重新挂链时已包含dentry */
+    }
+    else if (inode->dentry_hash != NULL) {
+        dentry->hash_next = inode->dentry_hash[dentry->hash & (inode->hash_size - 1)];
+        inode->dentry_hash[dentry->hash & (inode->hash_size - 1)] = dentry;
+    }
     return inode->dir_cnt;
 }
 /**
@@ -117,6 +244,7 @@ int newfs_alloc_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
 int newfs_drop_dentry(struct newfs_inode * inode, struct newfs_dentry * dentry) {
     int is_find = 0;
     struct newfs_dentry* dentry_cursor;
+    struct newfs_dentry** bucket;
     dentry_cursor = inode->dentrys;
     
     if (dentry_cursor == dentry) {
@@ -137,6 +265,13 @@ int newfs_drop_dentry(struct newfs_inode * inode, struct newfs_dentry * dentry)
     if (!is_find) {
         return -ENOENT;
     }
+    for (bucket = inode->dentry_hash ? &inode->dentry_hash[dentry->hash & (inode->hash_size - 1)] : NULL;
+         bucket != NULL && *bucket != NULL; bucket = &(*bucket)->hash_next) {
+        if (*bucket == dentry) {
+            *bucket = dentry->hash_next;
+            break;
+        }
+    }
     inode->dir_cnt--;
     return inode->dir_cnt;
 }
@@ -149,34 +284,20 @@ int newfs_drop_dentry(struct newfs_inode * inode, struct newfs_dentry * dentry)
  */
 struct newfs_inode* newfs_alloc_inode(struct newfs_dentry * dentry) {
     struct newfs_inode* inode;
-    int byte_cursor = 0; 
-    int bit_cursor  = 0; 
-    int ino_cursor  = 0;
-    int is_find_free_entry = 0;
+    int ino_cursor;
     /* 检查位图是否有空位 */
-    for (byte_cursor = 0; byte_cursor < super.sz_logit; byte_cursor++)
-    {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            if((super.inodes_bitmap[byte_cursor] & (0x1 << bit_cursor)) == 0) {    
-                                                      /* 当前ino_cursor位置空闲 */
-                super.inodes_bitmap[byte_cursor] |= (0x1 << bit_cursor);
-                is_find_free_entry = TRUE;           
-                break;
-            }
-            ino_cursor++;
-        }
-        if (is_find_free_entry) {
-            break;
-        }
-    }
-
-    if (!is_find_free_entry || ino_cursor >= super.inode_blks * super.blk_per_inode){
+    ino_cursor = newfs_bitmap_alloc(&super.inode_map);
+    if (ino_cursor < 0){
         printf("no space");
         return NULL;
     }
-        
+
 
     inode = (struct newfs_inode*)malloc(sizeof(struct newfs_inode));
+    if (inode == NULL) {
+        newfs_bitmap_free(&super.inode_map, ino_cursor);
+        return NULL;
+    }
     inode->ino  = ino_cursor; 
     inode->size = 0;
                                                       /* dentry指向inode */
@@ -187,7 +308,23 @@ struct newfs_inode* newfs_alloc_inode(struct newfs_dentry * dentry) {
     
     inode->dir_cnt = 0;
     inode->dentrys = NULL;
-    inode->data = NULL;
+    inode->dentry_hash = NULL;
+    inode->hash_size = 0;
+    inode->pages = NULL;
+    inode->page_cap = 0;
+    inode->blk_valid = 0;
+    inode->blks = NULL;
+    inode->blk_dirty = NULL;
+    inode->blk_cnt = 0;
+    inode->blk_cap = 0;
+    inode->meta_blks = NULL;
+    inode->meta_cnt = 0;
+    inode->map_stale = FALSE;
+    inode->rsv_blks = 0;
+    inode->dirty = FALSE;
+    inode->dirty_bytes = 0;
+    inode->dirty_next = NULL;
+    newfs_mem_track(inode);
     // if (inode->dentry->ftype == SFS_REG_FILE) {
     //    inode->data = (uint8_t *)malloc(SFS_BLKS_SZ(SFS_DATA_PER_FILE));
     // }
@@ -202,114 +339,431 @@ struct newfs_inode* newfs_alloc_inode(struct newfs_dentry * dentry) {
  * @return int 
  */
 int newfs_sync_inode(struct newfs_inode * inode) {
+    struct newfs_dentry*  dentry_cursor;
+    if (inode->dentry->ftype == NEWFS_DIR) {
+        for (dentry_cursor = inode->dentrys; dentry_cursor != NULL; 
+             dentry_cursor = dentry_cursor->brother) {
+            if (dentry_cursor->inode != NULL && newfs_sync_inode(dentry_cursor->inode) != 0) {
+                return -EIO;
+            }
+        }
+    }
+    if (newfs_write_inode(inode) != 0) {
+        return -EIO;
+    }
+    newfs_clean_inode(inode);
+    return 0;
+}
+/**
+ * @brief 在页与连续的暂存区之间复制n个逻辑块，写时NULL页视为全0
+ */
+static void newfs_inode_io_copy(int op, uint8_t** pages, int* slots, int n, uint8_t* staging) {
+    int i;
+    for (i = 0; i < n; i++) {
+        if (op == DDRIVER_AIO_READ) {
+            memcpy(pages[slots[i]], staging + i * super.sz_logit, super.sz_logit);
+        }
+        else if (pages[slots[i]] == NULL) {
+            memset(staging + i * super.sz_logit, 0, super.sz_logit);
+        }
+        else {
+            memcpy(staging + i * super.sz_logit, pages[slots[i]], super.sz_logit);
+        }
+    }
+}
+/**
+ * @brief 按块映射读写inode的第[lo, hi)个数据块，物理连续的块合并为一次多块请求，
+ *        零散的单块经newfs_driver_batch同时在途
+ * 
+ * @param op DDRIVER_AIO_READ / DDRIVER_AIO_WRITE
+ * @param pages 第i个逻辑块的内容位于pages[i]
+ * @param select 非NULL时只处理select[i]为真的块
+ * @return int 0成功，设备出错为-EIO，暂存区分配失败为-ENOMEM
+ */
+int newfs_inode_io(struct newfs_inode* inode, int op, uint8_t** pages, int lo, int hi, uint8_t* select) {
+    int* blk_offsets = (int *)malloc((hi > lo ? hi - lo : 1) * sizeof(int));
+    int* slots       = (int *)malloc((hi > lo ? hi - lo : 1) * sizeof(int));
+    int  single = 0, ret = 0, data_no, run, offset, i;
+    uint8_t* staging;
+    if (blk_offsets == NULL || slots == NULL) {
+        free(blk_offsets);
+        free(slots);
+        return -ENOMEM;
+    }
+    for (data_no = lo; data_no < hi && ret == 0; data_no += run) {
+        run = 1;
+        if (select != NULL && !select[data_no]) {
+            continue;
+        }
+        while (data_no + run < hi 
+               && (select == NULL || select[data_no + run])
+               && inode->blks[data_no + run] == inode->blks[data_no] + run) {
+            run++;
+        }
+        offset = super.data_offset + inode->blks[data_no] * super.sz_logit;
+        if (run == 1) {
+            blk_offsets[single] = offset;
+            slots[single++]     = data_no;
+            continue;
+        }
+        for (i = 0; i < run; i++) {
+            slots[single + i] = data_no + i;
+        }
+        if ((staging = (uint8_t *)malloc(run * super.sz_logit)) == NULL) {
+            ret = -ENOMEM;
+            break;
+        }
+        if (op == DDRIVER_AIO_WRITE) {
+            newfs_inode_io_copy(op, pages, slots + single, run, staging);
+            ret = newfs_driver_write(offset, staging, run * super.sz_logit);
+        }
+        else if ((ret = newfs_driver_read(offset, staging, run * super.sz_logit)) == 0) {
+            newfs_inode_io_copy(op, pages, slots + single, run, staging);
+        }
+        free(staging);
+    }
+    if (ret == 0 && single > 0) {
+        if ((staging = (uint8_t *)malloc(single * super.sz_logit)) == NULL) {
+            ret = -ENOMEM;
+        }
+        else {
+            if (op == DDRIVER_AIO_WRITE) {
+                newfs_inode_io_copy(op, pages, slots, single, staging);
+            }
+            ret = newfs_driver_batch(op, blk_offsets, staging, single);
+            if (ret == 0 && op == DDRIVER_AIO_READ) {
+                newfs_inode_io_copy(op, pages, slots, single, staging);
+            }
+            free(staging);
+        }
+    }
+    free(blk_offsets);
+    free(slots);
+    return ret;
+}
+/**
+ * @brief 写回失败时撤销本次新分配的数据块，块数恢复为上次写回时的old_cnt，
+ *        inode仍是脏的，重试时重新分配
+ */
+static void newfs_write_inode_undo(struct newfs_inode* inode, int old_cnt, int blk_cnt) {
+    newfs_release_data_blks(inode->blks + old_cnt, blk_cnt - old_cnt);
+    inode->blk_cnt = old_cnt;
+}
+/**
+ * @brief 只写回inode本身：目录写目录项块，文件写数据块，最后写inode。
+ *        已分配的块原地重写且只写blk_dirty中标记的，新增的块才分配，
+ *        并尽量紧接前一块，使文件在磁盘上连续；inode落盘后释放被截断掉的块
+ * 
+ * @param inode 
+ * @return int 
+ */
+int newfs_write_inode(struct newfs_inode * inode) {
     struct newfs_inode_d  inode_d;
     struct newfs_dentry*  dentry_cursor;
     struct newfs_dentry_d dentry_d;
     int ino             = inode->ino;
+    int blk_cnt = 0, old_cnt = inode->blk_cnt, data_no, ret;
+    uint8_t*  blks = NULL;
+    uint8_t** pages = NULL;
     inode_d.ino         = ino;
     inode_d.size        = inode->size;
     inode_d.ftype       = inode->dentry->ftype;
     inode_d.dir_cnt     = inode->dir_cnt;
-    int origin_offset;//数据偏移
     int inode_offset = super.inode_offset + (ino % super.blk_per_inode) * sizeof(struct newfs_inode_d) + (ino / super.blk_per_inode) * super.sz_logit; //相对于索引区起使地址的偏移
 
     if(inode->dentry->ftype == NEWFS_DIR){
-        int data_no = 0;
+        /* 目录项按块排布，不跨逻辑块；链表头是最新的目录项，倒序存放使新增目录项总在末尾 */
+        int dentry_per_blk = super.sz_logit / sizeof(struct newfs_dentry_d);
+        blk_cnt = newfs_dir_blks(inode->dir_cnt);
+        if(blk_cnt > newfs_map_max_blks()){
+            printf("dir too big and it will be truncate");
+            blk_cnt = newfs_map_max_blks();
+        }
+        if ((blks = (uint8_t *)calloc(blk_cnt ? blk_cnt : 1, super.sz_logit)) == NULL) {
+            return -ENOMEM;
+        }
         dentry_cursor = inode->dentrys;
-        if (dentry_cursor != NULL){
-            inode_d.block_pointer[data_no++] = newfs_search_data_bitmap();
-            origin_offset = super.data_offset + inode_d.block_pointer[0] * super.sz_logit;
-        }
-        int offset = origin_offset;
-        while (dentry_cursor != NULL) {
-            memcpy(dentry_d.fname, dentry_cursor->name, MAX_NAME_LEN);
-            dentry_d.ftype = dentry_cursor->ftype;
-            dentry_d.ino = dentry_cursor->ino;
-            if (newfs_driver_write(offset, (uint8_t *)&dentry_d, sizeof(struct newfs_dentry_d)) != 0) {
-                return -EIO;                     
+        for (data_no = inode->dir_cnt - 1; dentry_cursor != NULL; data_no--) {
+            if (data_no < blk_cnt * dentry_per_blk) {
+                memcpy(dentry_d.fname, dentry_cursor->name, MAX_NAME_LEN);
+                dentry_d.ftype = dentry_cursor->ftype;
+                dentry_d.ino = dentry_cursor->ino;
+                memcpy(blks + (data_no / dentry_per_blk) * super.sz_logit 
+                            + (data_no % dentry_per_blk) * sizeof(struct newfs_dentry_d), 
+                       &dentry_d, sizeof(struct newfs_dentry_d));
             }
-
-            if (dentry_cursor->inode != NULL) {
-                newfs_sync_inode(dentry_cursor->inode);
-            }
-
             dentry_cursor = dentry_cursor->brother;
-            offset += sizeof(struct newfs_dentry_d);
-            if(offset >= origin_offset + super.sz_logit){
-                inode_d.block_pointer[data_no++] = newfs_search_data_bitmap();
-                origin_offset = super.data_offset + inode_d.block_pointer[data_no] * super.sz_logit;
-                offset = origin_offset;
-            }
         }
-        inode_d.block_pointer[data_no] = -1;
+        if ((pages = (uint8_t **)malloc((blk_cnt ? blk_cnt : 1) * sizeof(uint8_t *))) == NULL) {
+            free(blks);
+            return -ENOMEM;
+        }
+        for (data_no = 0; data_no < blk_cnt; data_no++) {
+            pages[data_no] = blks + data_no * super.sz_logit;
+        }
     }else if(inode->dentry->ftype == NEWFS_REG_FILE){
-        int size = inode->size;
-        uint8_t* data_cursor = inode->data;
-        int data_no = 0;
-        while(size > 0){
-            if((inode_d.block_pointer[data_no] = newfs_search_data_bitmap(data_cursor, super.sz_logit)) < 0){//一次写入一个逻辑块，返回相应的数据块编号
-                return -ENOSPC;
-            }
-            int data_offset = super.data_offset + inode_d.block_pointer[data_no] * super.sz_logit;
-            if (newfs_driver_write(data_offset, (uint8_t *)data_cursor, super.sz_logit) != 0) {
-                return -EIO;
-            }
-            data_no++;
-            size -= super.sz_logit;
-            data_cursor += super.sz_logit;
-            if(data_no > NEWFS_DATA_BLK){
-                printf("file too big and it will be truncate");
-                break;
-            }
+        /* 直接从页写出，页中文件末尾之后总为0，未驻留的脏页为全0 */
+        blk_cnt = ROUND_UP(inode->size, super.sz_logit) / super.sz_logit;
+        if(blk_cnt > newfs_map_max_blks()){
+            printf("file too big and it will be truncate");
+            blk_cnt = newfs_map_max_blks();
+        }
+        if (newfs_page_reserve(inode, blk_cnt) != 0) {
+            return -ENOMEM;
         }
-        inode_d.block_pointer[data_no] = -1;//指示末尾
     }
-    /* 在数据块链接完善以后才能写inode本身 */
-    if (newfs_driver_write(inode_offset, (uint8_t *)&inode_d, sizeof(struct newfs_inode_d)) != 0){
-        return -EIO;
+
+    if (newfs_map_reserve(inode, blk_cnt) != 0) {
+        free(blks);
+        free(pages);
+        return -ENOMEM;
     }
+    for (data_no = old_cnt; data_no < blk_cnt; data_no++) {
+        inode->blks[data_no] = newfs_search_data_bitmap(data_no > 0 ? inode->blks[data_no - 1] + 1 : -1);
+        if (inode->blks[data_no] < 0) {
+            newfs_write_inode_undo(inode, old_cnt, data_no);
+            free(blks);
+            free(pages);
+            return -ENOSPC;
+        }
+        inode->blk_dirty[data_no] = TRUE;
+    }
+    ret = newfs_inode_io(inode, DDRIVER_AIO_WRITE, pages ? pages : inode->pages, 0, blk_cnt, inode->blk_dirty);
+    free(blks);
+    free(pages);
+    if (ret != 0) {                                 /* -EIO或暂存区分配失败的-ENOMEM */
+        newfs_write_inode_undo(inode, old_cnt, blk_cnt);
+        return ret;
+    }
+    /* 在数据块链接完善以后才能写inode本身；映射按新的块数写出，失败时恢复 */
+    inode->blk_cnt = blk_cnt;
+    if ((ret = newfs_map_store(inode, &inode_d, old_cnt)) != 0
+        || (ret = newfs_driver_write(inode_offset, (uint8_t *)&inode_d, sizeof(struct newfs_inode_d))) != 0) {
+        newfs_write_inode_undo(inode, old_cnt, blk_cnt);
+        inode->map_stale = TRUE;
+        return ret;
+    }
+    inode->map_stale = FALSE;
+    ret = blk_cnt < old_cnt ? newfs_release_data_blks(inode->blks + blk_cnt, old_cnt - blk_cnt) : 0;
+    if (inode->blk_dirty != NULL) {                 /* 空文件没有分配blk_dirty */
+        memset(inode->blk_dirty, 0, inode->blk_cap);
+    }
+    inode->blk_valid = blk_cnt;
+    super.rsv_blks -= inode->rsv_blks;              /* 预留的块已分配 */
+    inode->rsv_blks = 0;
+    return ret;                                     /* inode已落盘，丢弃截断掉的块失败时仍返回错误 */
+}
+/**
+ * @brief 初始化位图，各段在首次访问时才从设备读入
+ * 
+ * @param offset 位图区的设备偏移
+ * @param blks 位图占用的逻辑块数
+ * @param nbits 有效位数
+ * @param free 空闲位数，传-1时读入全部位图统计
+ * @return int 
+ */
+int newfs_bitmap_init(struct newfs_bitmap* bm, uint32_t offset, int blks, int nbits, int free) {
+    uint64_t* words;
+    int c, w, used = 0;
+    bm->offset = offset;
+    bm->blks   = blks;
+    bm->nbits  = nbits;
+    bm->hint   = 0;
+    bm->chunks = (uint8_t **)calloc(blks, sizeof(uint8_t *));
+    bm->dirty  = (uint8_t *)calloc(blks, sizeof(uint8_t));
+    if (bm->chunks == NULL || bm->dirty == NULL) {
+        return -ENOMEM;
+    }
+    if (free >= 0) {
+        bm->free = free;
+        return 0;
+    }
+    for (w = 0; w < ROUND_UP(nbits, 64) / 64; w++) {
+        c = w / (super.sz_logit / 8);
+        if ((words = (uint64_t *)newfs_bitmap_chunk(bm, c)) == NULL) {
+            return -EIO;
+        }
+        used += __builtin_popcountll(words[w % (super.sz_logit / 8)] 
+                                     & (w * 64 + 64 <= nbits ? ~0ULL : (1ULL << (nbits % 64)) - 1));
+    }
+    bm->free = nbits - used;
     return 0;
 }
-/*
- * 寻找空的数据块‘
-*/
-int newfs_search_data_bitmap(){
-    int byte_cursor = 0; 
-    int bit_cursor  = 0; 
-    int data_no_cursor  = 0;
-    int is_find_free_entry = 0;
-    /* 检查位图是否有空位 */
-    for (byte_cursor = 0; byte_cursor < super.sz_logit; byte_cursor++)
-    {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            if((super.data_bitmap[byte_cursor] & (0x1 << bit_cursor)) == 0) {    
-                                                      /* 当前ino_cursor位置空闲 */
-                super.data_bitmap[byte_cursor] |= (0x1 << bit_cursor);
-                is_find_free_entry = TRUE;           
-                break;
-            }
-            data_no_cursor++;
+/**
+ * @brief 释放位图占用的内存，调用前应先newfs_bitmap_sync
+ */
+void newfs_bitmap_destroy(struct newfs_bitmap* bm) {
+    int c;
+    for (c = 0; bm->chunks != NULL && c < bm->blks; c++) {
+        free(bm->chunks[c]);
+    }
+    free(bm->chunks);
+    free(bm->dirty);
+    bm->chunks = NULL;
+    bm->dirty  = NULL;
+}
+/**
+ * @brief 取位图的第c段，未读入时从设备读入
+ * 
+ * @return uint8_t* 出错返回NULL
+ */
+uint8_t* newfs_bitmap_chunk(struct newfs_bitmap* bm, int c) {
+    if (bm->chunks[c] == NULL) {
+        bm->chunks[c] = (uint8_t *)malloc(super.sz_logit);
+        if (bm->chunks[c] == NULL) {
+            return NULL;
         }
-        if (is_find_free_entry) {
-            break;
+        if (newfs_driver_read(bm->offset + c * super.sz_logit, bm->chunks[c], super.sz_logit) != 0) {
+            free(bm->chunks[c]);
+            bm->chunks[c] = NULL;
+            return NULL;
         }
     }
-    if(!is_find_free_entry || data_no_cursor >= super.data_blks){
+    return bm->chunks[c];
+}
+/**
+ * @brief 在位图中分配一个空闲位。按64位字扫描，从hint所在的字开始，
+ *        对取反后的字用ctz直接定位最低的空闲位。位i对应第i/8字节的第i%8位，
+ *        在小端机器上与按字读取的位序一致；扫描到哪一段才读入哪一段
+ * 
+ * @return int 分配到的位号，已满返回-ENOSPC
+ */
+int newfs_bitmap_alloc(struct newfs_bitmap* bm) {
+    int words_per_blk = super.sz_logit / 8;
+    int nwords = ROUND_UP(bm->nbits, 64) / 64;
+    uint64_t* words;
+    int i, w, bit;
+    if (bm->free == 0) {
         return -ENOSPC;
     }
-    return data_no_cursor;
+    for (i = 0; i < nwords; i++) {
+        w = (bm->hint + i) % nwords;
+        if ((words = (uint64_t *)newfs_bitmap_chunk(bm, w / words_per_blk)) == NULL) {
+            return -EIO;
+        }
+        if (words[w % words_per_blk] == ~0ULL) {
+            continue;
+        }
+        bit = w * 64 + __builtin_ctzll(~words[w % words_per_blk]);
+        if (bit >= bm->nbits) {                       /* 末尾字中的空闲位超出有效范围 */
+            continue;
+        }
+        words[w % words_per_blk] |= 1ULL << (bit % 64);
+        bm->dirty[w / words_per_blk] = TRUE;
+        bm->hint = w;
+        bm->free--;
+        return bit;
+    }
+    return -ENOSPC;
+}
+/**
+ * @brief 分配指定的一位，用于让新数据块紧接文件已有的块
+ * 
+ * @return int 分配到的位号，该位已被占用返回-EEXIST
+ */
+int newfs_bitmap_alloc_at(struct newfs_bitmap* bm, int bit) {
+    int words_per_blk = super.sz_logit / 8;
+    uint64_t* words;
+    if (bit < 0 || bit >= bm->nbits) {
+        return -EINVAL;
+    }
+    if ((words = (uint64_t *)newfs_bitmap_chunk(bm, bit / 64 / words_per_blk)) == NULL) {
+        return -EIO;
+    }
+    if (words[(bit / 64) % words_per_blk] & (1ULL << (bit % 64))) {
+        return -EEXIST;
+    }
+    words[(bit / 64) % words_per_blk] |= 1ULL << (bit % 64);
+    bm->dirty[bit / 64 / words_per_blk] = TRUE;
+    bm->hint = bit / 64;
+    bm->free--;
+    return bit;
+}
+/**
+ * @brief 释放位图中的一位，释放位置在hint之前时回退hint，保持分配紧凑
+ * 
+ * @return int 该位本就空闲时为-EINVAL，不改动free与hint
+ */
+int newfs_bitmap_free(struct newfs_bitmap* bm, int bit) {
+    int words_per_blk = super.sz_logit / 8;
+    uint64_t* words;
+    if (bit < 0 || bit >= bm->nbits) {
+        return -EINVAL;
+    }
+    if ((words = (uint64_t *)newfs_bitmap_chunk(bm, bit / 64 / words_per_blk)) == NULL) {
+        return -EIO;
+    }
+    if (!(words[(bit / 64) % words_per_blk] & (1ULL << (bit % 64)))) {   /* 重复释放会虚增free */
+        return -EINVAL;
+    }
+    words[(bit / 64) % words_per_blk] &= ~(1ULL << (bit % 64));
+    bm->dirty[bit / 64 / words_per_blk] = TRUE;
+    bm->free++;
+    if (bit / 64 < bm->hint) {
+        bm->hint = bit / 64;
+    }
+    return 0;
+}
+/**
+ * @brief 只写回修改过的位图段
+ * 
+ * @return int 
+ */
+int newfs_bitmap_sync(struct newfs_bitmap* bm) {
+    int c;
+    for (c = 0; c < bm->blks; c++) {
+        if (!bm->dirty[c]) {
+            continue;
+        }
+        if (newfs_driver_write(bm->offset + c * super.sz_logit, bm->chunks[c], super.sz_logit) != 0) {
+            return -EIO;
+        }
+        bm->dirty[c] = FALSE;
+    }
+    return 0;
+}
+/*
+ * 寻找空的数据块‘，goal空闲时优先分配goal
+*/
+int newfs_search_data_bitmap(int goal){
+    int data_no;
+    if (goal >= 0 && (data_no = newfs_bitmap_alloc_at(&super.data_map, goal)) >= 0) {
+        return data_no;
+    }
+    return newfs_bitmap_alloc(&super.data_map);
 }
 /*
  * 释放数据块索引‘
 */
 int newfs_release_data_bitmap(int data_no){
-    if(data_no >= super.data_blks){
-        return -1;
+    return newfs_release_data_blks(&data_no, 1);
+}
+/**
+ * @brief 释放blks中的cnt个数据块：逐块清除位图，物理连续的块合并为一次丢弃
+ *
+ * @return int 位图或丢弃的第一个错误，出错时其余块照常释放
+ */
+int newfs_release_data_blks(int* blks, int cnt) {
+    int start = 0, run = 0, i, err, ret = 0;
+    for (i = 0; i <= cnt; i++) {
+        if (i < cnt && (err = newfs_bitmap_free(&super.data_map, blks[i])) != 0) {
+            ret = ret ? ret : err;                  /* 未释放的块不丢弃，也使当前段在此断开 */
+            continue;
+        }
+        if (i < cnt && run > 0 && blks[i] == start + run) {
+            run++;
+            continue;
+        }
+        if (run > 0 && (err = newfs_driver_discard(super.data_offset + start * super.sz_logit,
+                                                   run * super.sz_logit)) != 0) {
+            ret = ret ? ret : err;
+        }
+        if (i < cnt) {
+            start = blks[i];
+            run   = 1;
+        }
     }
-    int byte_cursor = data_no / 8; 
-    int bit_cursor  = data_no % 8;                                                     
-    super.data_bitmap[byte_cursor] &= (uint8_t)(~(0x1 << bit_cursor));
-    return 0;
+    return ret;
 }
 /**
  * @brief 删除内存中的一个inode
@@ -343,109 +797,162 @@ int newfs_drop_inode(struct newfs_inode* inode){
     struct newfs_dentry* dentry_cursor;
     struct newfs_dentry* dentry_to_free;
     struct newfs_inode* inode_cursor;
-
-    int byte_cursor = 0;
-    int bit_cursor = 0;
+    int ret, err;
 
 
     if (inode == super.root_dentry->inode){
         return -1;
     }
     // 释放索引位图
-    byte_cursor = inode->ino / 8;
-    bit_cursor = inode->ino % 8;
-    super.inodes_bitmap[byte_cursor] &= (uint8_t)(~(0x1 << bit_cursor));
-     // 无需释放数据,位图只在sync时指定
+    newfs_bitmap_free(&super.inode_map, inode->ino);
+    // 释放已写回的数据块
+    ret = newfs_map_release(inode);
     if(inode->dentry->ftype == NEWFS_DIR){
         dentry_cursor = inode->dentrys;
         while(dentry_cursor){
+            if (dentry_cursor->inode == NULL) {  /* 读入未加载的子inode，以便释放其数据块 */
+                newfs_read_inode(dentry_cursor, dentry_cursor->ino);
+            }
             inode_cursor = dentry_cursor->inode;
-            newfs_drop_inode(inode_cursor);
+            if (inode_cursor != NULL && (err = newfs_drop_inode(inode_cursor)) != 0) {
+                ret = ret ? ret : err;
+            }
             newfs_drop_dentry(inode, dentry_cursor);
             dentry_to_free = dentry_cursor;
             dentry_cursor = dentry_cursor->brother;
             free(dentry_to_free);
         }   
+        free(inode->dentry_hash);
     }else{
         // 只需释放数据
-        if (inode->data)
-            free(inode->data);
-       
+        newfs_mem_forget(inode);
+        newfs_page_release(inode);
     }
+    newfs_clean_inode(inode);
      // 释放inode
     free(inode);
-    return 0;
+    return ret;
 }
 
+/**
+ * @brief 读入inode失败时释放已建立的映射、目录项与inode本身，dentry->inode保持NULL
+ *
+ * @return struct newfs_inode* 总为NULL
+ */
+static struct newfs_inode* newfs_read_inode_fail(struct newfs_inode* inode) {
+    struct newfs_dentry* dentry_cursor = inode->dentrys;
+    struct newfs_dentry* dentry_to_free;
+    while (dentry_cursor) {
+        dentry_to_free = dentry_cursor;
+        dentry_cursor = dentry_cursor->brother;
+        free(dentry_to_free);
+    }
+    free(inode->dentry_hash);
+    free(inode->blks);
+    free(inode->blk_dirty);
+    free(inode->meta_blks);
+    free(inode);
+    return NULL;
+}
 /**
  * @brief 
  * 
  * @param dentry dentry指向ino，读取该inode
  * @param ino inode唯一编号
- * @return struct sfs_inode* 
+ * @return struct sfs_inode* 失败时返回NULL，dentry->inode不变
  */
 struct newfs_inode* newfs_read_inode(struct newfs_dentry * dentry, int ino) {
-    struct newfs_inode* inode = (struct newfs_inode*)malloc(sizeof(struct newfs_inode));
+    struct newfs_inode* inode;
     struct newfs_inode_d inode_d;
     struct newfs_dentry* sub_dentry;
     struct newfs_dentry_d dentry_d;
     int    dir_cnt = 0, i;
     /* 从磁盘读索引结点 */
-    int inode_offset = super.inode_offset + ino * sizeof(struct newfs_inode_d);// todo
+    int inode_offset = super.inode_offset + (ino % super.blk_per_inode) * sizeof(struct newfs_inode_d) + (ino / super.blk_per_inode) * super.sz_logit; /* 与newfs_write_inode一致 */
     if (newfs_driver_read(inode_offset, (uint8_t *)&inode_d, 
                         sizeof(struct newfs_inode_d)) != 0) {
         return NULL;                    
     }
+    if ((inode = (struct newfs_inode*)malloc(sizeof(struct newfs_inode))) == NULL) {
+        return NULL;
+    }
     inode->dir_cnt = 0;
     inode->ino = inode_d.ino;
     inode->size = inode_d.size;
     inode->dentry = dentry;
     inode->dentrys = NULL;
-    dentry->inode = inode;
+    inode->dentry_hash = NULL;
+    inode->hash_size = 0;
+    inode->pages = NULL;
+    inode->page_cap = 0;
+    inode->blks = NULL;
+    inode->blk_dirty = NULL;
+    inode->blk_cnt = 0;
+    inode->blk_cap = 0;
+    inode->blk_valid = 0;
+    inode->meta_blks = NULL;
+    inode->meta_cnt = 0;
+    inode->map_stale = FALSE;
+    inode->rsv_blks = 0;
+    inode->dirty = FALSE;
+    inode->dirty_bytes = 0;
+    inode->dirty_ms = 0;
+    inode->dirty_next = NULL;
+    inode->lru_prev = NULL;
+    inode->lru_next = NULL;
+    if (newfs_map_load(inode, &inode_d) != 0) {
+        return newfs_read_inode_fail(inode);
+    }
+    inode->blk_valid = inode->blk_cnt;
 
     if (dentry->ftype == NEWFS_DIR){
-        
+        /* 目录项块一次读入，物理连续的块合并为一次请求 */
+        int dentry_per_blk = super.sz_logit / sizeof(struct newfs_dentry_d);
+        uint8_t*  blks  = (uint8_t *)malloc((inode->blk_cnt ? inode->blk_cnt : 1) * super.sz_logit);
+        uint8_t** pages = (uint8_t **)malloc((inode->blk_cnt ? inode->blk_cnt : 1) * sizeof(uint8_t *));
+        if (blks == NULL || pages == NULL) {
+            free(pages);
+            free(blks);
+            return newfs_read_inode_fail(inode);
+        }
+        for (i = 0; i < inode->blk_cnt; i++) {
+            pages[i] = blks + i * super.sz_logit;
+        }
+        if (newfs_inode_io(inode, DDRIVER_AIO_READ, pages, 0, inode->blk_cnt, NULL) != 0) {
+            free(pages);
+            free(blks);
+            return newfs_read_inode_fail(inode);
+        }
+        free(pages);
         dir_cnt = inode_d.dir_cnt;
-        int block_pointer_no = 0;
-        int data_offset = inode_d.block_pointer[block_pointer_no++];
-        data_offset = super.data_offset + data_offset * super.sz_logit;
-        int block_offset = 0;
+        if (dir_cnt > inode->blk_cnt * dentry_per_blk) {
+            dir_cnt = inode->blk_cnt * dentry_per_blk;
+        }
+        if (newfs_dentry_hash_resize(inode, dir_cnt) != 0) {  /* 一次建好哈希表，插入时不再扩容 */
+            free(blks);
+            return newfs_read_inode_fail(inode);
+        }
         for (i = 0; i < dir_cnt; i++) { 
-            if(block_offset >= super.sz_logit && block_pointer_no <= NEWFS_DATA_BLK) {
-                data_offset = inode_d.block_pointer[block_pointer_no++];
-                data_offset = super.data_offset + data_offset * super.sz_logit;
-                block_offset = 0;
-            }         
-            if (newfs_driver_read(data_offset + block_offset, (uint8_t *)&dentry_d, sizeof(struct newfs_dentry_d)) != 0){
-                return NULL;
-            } 
-            block_offset += sizeof(struct newfs_dentry_d);   
-            sub_dentry = new_dentry(dentry_d.fname, dentry_d.ftype);
+            memcpy(&dentry_d, blks + (i / dentry_per_blk) * super.sz_logit 
+                                   + (i % dentry_per_blk) * sizeof(struct newfs_dentry_d), 
+                   sizeof(struct newfs_dentry_d));
+            if ((sub_dentry = new_dentry(dentry_d.fname, dentry_d.ftype)) == NULL) {
+                free(blks);
+                return newfs_read_inode_fail(inode);
+            }
             sub_dentry->parent = dentry;
             sub_dentry->ino = dentry_d.ino;
             newfs_alloc_dentry(inode, sub_dentry);
         } 
+        free(blks);
     }else if(dentry->ftype == NEWFS_REG_FILE){
-        inode->data = (uint8_t *)malloc(sizeof(uint8_t) * inode_d.size);
-        uint8_t* data_cursor = inode->data;
-        int block_pointer_no = 0;
-        int data_no = -1;
-        int data_offset;
-        while((data_no = inode_d.block_pointer[block_pointer_no++]) != -1){
-            data_offset = super.data_offset + data_no * super.sz_logit;
-            int size = inode_d.size;
-            if (size > super.sz_logit && newfs_driver_read(data_offset, data_cursor, super.sz_logit) != 0){
-                printf("IO error");
-                return NULL;
-            }else if(newfs_driver_read(data_offset, data_cursor, size) != 0){
-                printf("IO error");
-                return NULL;
-            }
-            size -= super.sz_logit;
-            data_cursor += super.sz_logit;
+        /* 文件数据在读写时按页读入 */
+        if (inode->size > inode->blk_cnt * super.sz_logit) {
+            inode->size = inode->blk_cnt * super.sz_logit;
         }
-        
     }
+    dentry->inode = inode;                        /* 读入成功后才挂到dentry上 */
+    newfs_mem_track(inode);
     return inode;
 }
 
@@ -492,7 +999,7 @@ struct newfs_dentry* newfs_get_dentry(struct newfs_inode * inode, int dir) {
  *      4) find b's dentry    如果此时找不到了，is_find=FALSE且返回的是a的inode对应的dentry
  * 
  * @param path 
- * @return struct sfs_dentry* 
+ * @return struct sfs_dentry* 读入途经的inode失败时返回NULL
  */
 struct newfs_dentry* newfs_lookup(const char * path, int* is_find, int* is_root) {
     struct newfs_dentry* dentry_cursor = super.root_dentry;
@@ -502,7 +1009,7 @@ struct newfs_dentry* newfs_lookup(const char * path, int* is_find, int* is_root)
     int lvl = 0;
     int is_hit;
     char* fname = NULL;
-    char* path_cpy = (char *)malloc(sizeof(path));
+    char* path_cpy = (char *)malloc(strlen(path) + 1);
     *is_root = 0;
     strcpy(path_cpy, path);
 
@@ -515,11 +1022,14 @@ struct newfs_dentry* newfs_lookup(const char * path, int* is_find, int* is_root)
     while (fname)
     {
         lvl++;
-        if(dentry_cursor->inode == NULL){/* Cache机制 */
-            newfs_read_inode(dentry_cursor, dentry_cursor->ino);
+        if(dentry_cursor->inode == NULL                 /* Cache机制 */
+           && newfs_read_inode(dentry_cursor, dentry_cursor->ino) == NULL){
+            free(path_cpy);
+            return NULL;
         }
 
         inode = dentry_cursor->inode;
+        newfs_mem_touch(inode);
 
         if(inode->dentry->ftype == NEWFS_REG_FILE && lvl < total_lvl){
             printf("Not a dir");
@@ -528,15 +1038,8 @@ struct newfs_dentry* newfs_lookup(const char * path, int* is_find, int* is_root)
         }
 
         if(inode->dentry->ftype == NEWFS_DIR){
-            dentry_cursor = inode->dentrys;
-            is_hit = 0;
-            while (dentry_cursor){
-                if (memcmp(dentry_cursor->name, fname, strlen(fname)) == 0){
-                    is_hit = 1;
-                    break;
-                }
-                dentry_cursor = dentry_cursor->brother;
-            }
+            dentry_cursor = newfs_find_dentry(inode, fname);
+            is_hit = dentry_cursor != NULL;
 
             if(!is_hit) {
                 *is_find = 0;
@@ -554,12 +1057,26 @@ struct newfs_dentry* newfs_lookup(const char * path, int* is_find, int* is_root)
         fname = strtok(NULL, "/"); 
     }
 
-    if(dentry_ret->inode == NULL){
-        dentry_ret->inode = newfs_read_inode(dentry_ret, dentry_ret->ino);
+    free(path_cpy);
+    if(dentry_ret->inode == NULL && newfs_read_inode(dentry_ret, dentry_ret->ino) == NULL){
+        return NULL;
     }
+    newfs_mem_touch(dentry_ret->inode);
     return dentry_ret;
 }
 
+/**
+ * @brief 写回inode位图与数据位图中修改过的块
+ * 
+ * @return int 
+ */
+int newfs_sync_bitmaps() {
+    if (newfs_bitmap_sync(&super.inode_map) != 0 || newfs_bitmap_sync(&super.data_map) != 0) {
+        return -EIO;
+    }
+    return 0;
+}
+
 int newfs_mount() {
     super.fd = ddriver_open(newfs_options.device);
 	if (super.fd < 0) {
@@ -575,9 +1092,28 @@ int newfs_mount() {
     super.is_mounted = FALSE;
 	ddriver_ioctl(super.fd, IOC_REQ_DEVICE_SIZE,  &super.sz_disk);
     ddriver_ioctl(super.fd, IOC_REQ_DEVICE_IO_SZ, &super.sz_io);
+    if (ddriver_aio_setup(super.fd, NEWFS_AIO_DEPTH, 0) != 0) {
+        return -EIO;
+    }
 	super.sz_logit = 2 * super.sz_io;
+    if (newfs_cache_init() != 0) {
+        return -ENOMEM;
+    }
+    if (newfs_writeback_init() != 0) {
+        return -EAGAIN;
+    }
+    super.lru_head  = NULL;
+    super.lru_tail  = NULL;
+    super.mem_bytes = 0;
+    super.rsv_blks  = 0;
+    if (newfs_options.mem_limit <= 0) {
+        newfs_options.mem_limit = NEWFS_MEM_LIMIT;
+    }
 
 	root_dentry = new_dentry("/", NEWFS_DIR);     /* 根目录项每次挂载时新建 */
+	if (root_dentry == NULL) {
+		return -ENOMEM;
+	}
 
 	if (newfs_driver_read(NEWFS_SUPER_OFS, (uint8_t *)(&newfs_super_d), 
                 sizeof(struct newfs_super_d)) != 0) {
@@ -595,18 +1131,32 @@ int newfs_mount() {
 		// 计算除法时将1 / blk_per_inode 向上取整为1，除完以后在ROUNDUP为blk_per_inode
 		int inode_num = (num_logit - 1 - 1 - super_blks) / (NEWFS_DATA_BLK + 1);
 		inode_num = ROUND_UP(inode_num, blk_per_inode);
-		// 确保索引数量和文件数量不超过位图大小，即一个逻辑块的bit数， 即sz_logit * 8
-		// inode_num = inode_num > (8 * super.sz_logit) ? (8 * super.sz_logit) : inode_num;
+		// 位图按实际数量占用若干逻辑块，每块可表示sz_logit * 8个对象
+		int bits_per_blk = super.sz_logit * UINT8_BITS;
+		int inode_bitmap_blks = ROUND_UP(inode_num, bits_per_blk) / bits_per_blk;
+		// 剩余空间由数据位图和数据块分享，data_bitmap_blks * (bits_per_blk + 1) >= 剩余块数
+		int rest_blks = num_logit - super_blks - inode_bitmap_blks - inode_num / blk_per_inode;
+		int data_bitmap_blks = ROUND_UP(rest_blks, bits_per_blk + 1) / (bits_per_blk + 1);
 
 		newfs_super_d.blk_per_inode = blk_per_inode;
 		newfs_super_d.inode_blks = inode_num / blk_per_inode;
+		newfs_super_d.inode_bitmap_blks = inode_bitmap_blks;
+		newfs_super_d.data_bitmap_blks = data_bitmap_blks;
 		newfs_super_d.inode_bitmap_offset = NEWFS_SUPER_OFS + super_blks * super.sz_logit;
-		newfs_super_d.data_bitmap_offset = newfs_super_d.inode_bitmap_offset + super.sz_logit;
-		newfs_super_d.inode_offset = newfs_super_d.data_bitmap_offset + super.sz_logit;
+		newfs_super_d.data_bitmap_offset = newfs_super_d.inode_bitmap_offset + inode_bitmap_blks * super.sz_logit;
+		newfs_super_d.inode_offset = newfs_super_d.data_bitmap_offset + data_bitmap_blks * super.sz_logit;
 		newfs_super_d.data_offset = newfs_super_d.inode_offset + newfs_super_d.inode_blks * super.sz_logit;
-        newfs_super_d.data_blks = num_logit - super_blks - newfs_super_d.inode_blks - 2;
+        newfs_super_d.data_blks = rest_blks - data_bitmap_blks;
+        newfs_super_d.inode_free = inode_num;
+        newfs_super_d.data_free = newfs_super_d.data_blks;
+        newfs_super_d.version = newfs_options.indirect ? NEWFS_VERSION_INDIRECT : NEWFS_VERSION_EXTENT;
+        newfs_super_d.clean = TRUE;
 
 		newfs_super_d.sz_usage = 0;
+		                                              /* 丢弃位图及之后的全部区域，位图读出即为空 */
+		newfs_driver_discard(newfs_super_d.inode_bitmap_offset, 
+		                     newfs_super_d.data_offset + newfs_super_d.data_blks * super.sz_logit
+		                     - newfs_super_d.inode_bitmap_offset);
 		
 		is_init = 1;
 
@@ -614,8 +1164,6 @@ int newfs_mount() {
 	/* 建立 in-memory 结构 */
 	super.sz_usage   = newfs_super_d.sz_usage; 
 
-	super.inodes_bitmap = (uint8_t *)malloc(super.sz_logit);
-	super.data_bitmap = (uint8_t *)malloc(super.sz_logit);
 	super.blk_per_inode = newfs_super_d.blk_per_inode;
 	super.inode_blks = newfs_super_d.inode_blks;
 	super.inode_bitmap_offset = newfs_super_d.inode_bitmap_offset;
@@ -623,15 +1171,37 @@ int newfs_mount() {
 	super.inode_offset = newfs_super_d.inode_offset;
 	super.data_offset = newfs_super_d.data_offset;
     super.data_blks = newfs_super_d.data_blks;
+    super.version = newfs_super_d.version;
 
-
-	if (newfs_driver_read(newfs_super_d.inode_bitmap_offset, (uint8_t *)(super.inodes_bitmap), super.sz_logit) != 0) {
-        return -EIO;
-    }
-
-	if (newfs_driver_read(newfs_super_d.data_bitmap_offset, (uint8_t *)(super.data_bitmap), super.sz_logit) != 0) {
-        return -EIO;
-    }
+	                                              /* 位图按需分段读入 */
+	if (newfs_super_d.inode_bitmap_blks == 0) {   /* 旧格式：位图各占一块，空闲数需统计 */
+		int bits_per_blk = super.sz_logit * UINT8_BITS;
+		int inode_num = super.inode_blks * super.blk_per_inode;
+		int super_blks = ROUND_UP(sizeof(struct newfs_super_d), super.sz_logit) / super.sz_logit;
+		/* 旧版本卸载时从未写入data_blks，按旧布局由磁盘大小推算 */
+		super.data_blks = super.sz_disk / super.sz_logit - super_blks - super.inode_blks - 2;
+		if (newfs_bitmap_init(&super.inode_map, super.inode_bitmap_offset, 1, 
+		                      inode_num < bits_per_blk ? inode_num : bits_per_blk, -1) != 0
+		    || newfs_bitmap_init(&super.data_map, super.data_bitmap_offset, 1, 
+		                         super.data_blks < bits_per_blk ? super.data_blks : bits_per_blk, -1) != 0) {
+			return -EIO;
+		}
+	}
+	else if (newfs_bitmap_init(&super.inode_map, super.inode_bitmap_offset, newfs_super_d.inode_bitmap_blks,
+	                           super.inode_blks * super.blk_per_inode, 
+	                           newfs_super_d.clean ? (int)newfs_super_d.inode_free : -1) != 0
+	         || newfs_bitmap_init(&super.data_map, super.data_bitmap_offset, newfs_super_d.data_bitmap_blks,
+	                              super.data_blks, 
+	                              newfs_super_d.clean ? (int)newfs_super_d.data_free : -1) != 0) {
+		return -EIO;                                  /* 未正常卸载时空闲数按位图重新统计 */
+	}
+	if (!is_init && newfs_super_d.clean) {            /* 回写线程不写超级块，卸载前崩溃时需重新统计 */
+		newfs_super_d.clean = FALSE;
+		if (newfs_driver_write_flags(NEWFS_SUPER_OFS, (uint8_t *)&newfs_super_d, 
+		                             sizeof(struct newfs_super_d), DDRIVER_WRITE_FUA) != 0) {
+			return -EIO;
+		}
+	}
 
 
 	if (is_init) {                                    /* 分配根节点 */
@@ -640,7 +1210,9 @@ int newfs_mount() {
     }
     
     root_inode           = newfs_read_inode(root_dentry, NEWFS_ROOT_INO);  /* 读取根目录 */
-    root_dentry->inode   = root_inode;
+    if (root_inode == NULL) {
+        return -EIO;
+    }
     super.root_dentry = root_dentry;
     super.is_mounted  = 1;
 
@@ -653,13 +1225,25 @@ int newfs_mount() {
  */
 int newfs_umount() {
     struct newfs_super_d  newfs_super_d; 
+    int ret = 0;
 
     if (!super.is_mounted) {
         return 0;
     }
 
-    newfs_sync_inode(super.root_dentry->inode);     /* 从根节点向下刷写节点 */
-                                                    
+    newfs_writeback_exit();
+    if (newfs_writeback(TRUE) < 0) {                /* 只写回脏inode及其脏块，失败的inode不影响其余部分落盘 */
+        ret = -EIO;
+    }
+                                                    /* 先写位图并刷写，超级块最后以FUA提交 */
+    if (newfs_sync_bitmaps() != 0) {
+        return -EIO;
+    }
+
+    if (newfs_driver_flush() != 0) {
+        return -EIO;
+    }
+
     newfs_super_d.magic_num           = NEWFS_MAGIC_NUM;
     newfs_super_d.sz_usage            = super.sz_usage;
     newfs_super_d.inode_bitmap_offset = super.inode_bitmap_offset;
@@ -668,23 +1252,29 @@ int newfs_umount() {
     newfs_super_d.blk_per_inode       = super.blk_per_inode;
     newfs_super_d.inode_offset        = super.inode_offset;
     newfs_super_d.data_offset         = super.data_offset;
-
-
-    if (newfs_driver_write(NEWFS_SUPER_OFS, (uint8_t *)&newfs_super_d, sizeof(struct newfs_super_d)) != 0) {
-        return -EIO;
+    newfs_super_d.data_blks           = super.data_blks;
+    newfs_super_d.inode_bitmap_blks   = super.inode_map.blks;
+    newfs_super_d.data_bitmap_blks    = super.data_map.blks;
+    if (super.inode_map.nbits != super.inode_blks * super.blk_per_inode 
+        || super.data_map.nbits != super.data_blks) {  /* 旧格式且位图容量不足，保持旧格式 */
+        newfs_super_d.inode_bitmap_blks = 0;
+        newfs_super_d.data_bitmap_blks  = 0;
     }
+    newfs_super_d.inode_free          = super.inode_map.free;
+    newfs_super_d.data_free           = super.data_map.free;
+    newfs_super_d.version             = super.version;
+    newfs_super_d.clean               = TRUE;
 
-    if (newfs_driver_write(newfs_super_d.inode_bitmap_offset, (uint8_t *)(super.inodes_bitmap), super.sz_logit) != 0) {
-        return -EIO;
-    }
 
-    if (newfs_driver_write(newfs_super_d.data_bitmap_offset, (uint8_t *)(super.data_bitmap), super.sz_logit) != 0) {
+    if (newfs_driver_write_flags(NEWFS_SUPER_OFS, (uint8_t *)&newfs_super_d, 
+                                 sizeof(struct newfs_super_d), DDRIVER_WRITE_FUA) != 0) {
         return -EIO;
     }
 
-    free(super.inodes_bitmap);
-    free(super.data_bitmap);
+    newfs_bitmap_destroy(&super.inode_map);
+    newfs_bitmap_destroy(&super.data_map);
+    newfs_cache_destroy();
     ddriver_close(super.fd);
 
-    return 0;
+    return ret;
 }
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include "newfs.h"
+#include <time.h>
+
+extern struct newfs_super super;
+extern struct custom_options newfs_options;
+
+static __thread int newfs_lock_depth;              /* 本线程持有全局锁的层数 */
+
+uint64_t newfs_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+/**
+ * @brief 全局锁，FUSE默认多线程调用各操作，且与回写线程共享内存结构
+ */
+void newfs_lock() {
+    pthread_mutex_lock(&super.lock);
+    newfs_lock_depth++;
+}
+/**
+ * @brief 释放全局锁并原样返回ret，便于写成return newfs_unlock(ret);
+ *        最外层的操作结束时不再持有inode指针，在此回收超出预算的内存。
+ *        回收时的写回结果与newfs_flusher一样记入super.wb_error
+ */
+int newfs_unlock(int ret) {
+    int err;
+    if (--newfs_lock_depth == 0 && (err = newfs_mem_reclaim()) != 0) {
+        super.wb_error = err < 0 ? err : 0;
+    }
+    pthread_mutex_unlock(&super.lock);
+    return ret;
+}
+/**
+ * @brief 回写线程：每隔dirty_expire / 2检查一次，或在脏数据超过dirty_bytes时被唤醒，
+ *        写回超时的脏inode后刷写位图并下发flush。出错的inode留在脏链表上下次重试，
+ *        错误号记入super.wb_error，在此期间写入返回该错误
+ */
+void* newfs_flusher(void* arg) {
+    struct timespec ts;
+    int ret;
+    int period = newfs_options.dirty_expire / 2 > 0 ? newfs_options.dirty_expire / 2 : 1;
+    newfs_lock();
+    while (!super.flusher_stop) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec  += period / 1000;
+        ts.tv_nsec += (period % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&super.flusher_cond, &super.lock, &ts);
+        if (super.flusher_stop) {
+            break;
+        }
+        ret = newfs_writeback(FALSE);
+        if (ret > 0 && (ret = newfs_sync_bitmaps()) == 0) {
+            ret = newfs_driver_flush();
+        }
+        super.wb_error = ret < 0 ? ret : 0;
+        if ((ret = newfs_mem_reclaim()) < 0) {      /* 刚写回的inode可以淘汰了 */
+            super.wb_error = ret;
+        }
+    }
+    newfs_unlock(0);
+    return NULL;
+}
+/**
+ * @brief 挂载时初始化全局锁与脏链表，开启回写模式时启动回写线程
+ *
+ * @return int
+ */
+int newfs_writeback_init() {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);   /* rename内调用mknod等 */
+    pthread_mutex_init(&super.lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_cond_init(&super.flusher_cond, NULL);
+    super.dirty_list   = NULL;
+    super.dirty_bytes  = 0;
+    super.flusher_stop = FALSE;
+    super.wb_error     = 0;
+    if (newfs_options.dirty_expire <= 0) {
+        newfs_options.dirty_expire = NEWFS_DIRTY_EXPIRE;
+    }
+    if (newfs_options.dirty_bytes <= 0) {
+        newfs_options.dirty_bytes = NEWFS_DIRTY_BYTES;
+    }
+    if (newfs_options.writeback
+        && pthread_create(&super.flusher, NULL, newfs_flusher, NULL) != 0) {
+        return -EAGAIN;
+    }
+    return 0;
+}
+/**
+ * @brief 卸载时停止回写线程，剩余脏数据由newfs_umount写回
+ */
+void newfs_writeback_exit() {
+    if (newfs_options.writeback) {
+        newfs_lock();
+        super.flusher_stop = TRUE;
+        pthread_cond_signal(&super.flusher_cond);
+        newfs_unlock(0);
+        pthread_join(super.flusher, NULL);
+    }
+    pthread_cond_destroy(&super.flusher_cond);
+    pthread_mutex_destroy(&super.lock);
+}
+/**
+ * @brief 标记inode及其数据块[lo, hi)为脏并挂入脏链表，脏数据过多时唤醒回写线程。
+ *        尚未分配的块写回时总会写出，不必标记
+ *
+ * @param bytes 本次修改的字节数
+ */
+void newfs_mark_blks(struct newfs_inode* inode, int lo, int hi, int bytes) {
+    int blk;
+    for (blk = lo; blk < hi && blk < inode->blk_cnt; blk++) {
+        inode->blk_dirty[blk] = TRUE;
+    }
+    if (!inode->dirty) {
+        inode->dirty      = TRUE;
+        inode->dirty_ms   = newfs_now_ms();
+        inode->dirty_next = super.dirty_list;
+        super.dirty_list  = inode;
+    }
+    inode->dirty_bytes += bytes;
+    super.dirty_bytes  += bytes;
+    if (newfs_options.writeback && super.dirty_bytes >= newfs_options.dirty_bytes) {
+        pthread_cond_signal(&super.flusher_cond);
+    }
+}
+/**
+ * @brief 文件内容[offset, offset + size)被修改，size为0时只标记inode本身
+ */
+void newfs_mark_dirty(struct newfs_inode* inode, int offset, int size) {
+    if (size <= 0) {
+        newfs_mark_blks(inode, 0, 0, 0);
+        return;
+    }
+    newfs_mark_blks(inode, offset / super.sz_logit, 
+                    ROUND_UP(offset + size, super.sz_logit) / super.sz_logit, size);
+}
+/**
+ * @brief 目录新增或即将删除dentry。目录项倒序存放，dentry的序号即链表中排在它之后的
+ *        目录项个数；删除时其后的目录项前移，因此从所在块起到末尾都需重写
+ */
+void newfs_mark_dentry(struct newfs_inode* dir, struct newfs_dentry* dentry) {
+    int dentry_per_blk = super.sz_logit / sizeof(struct newfs_dentry_d);
+    int index = 0;
+    for (dentry = dentry->brother; dentry != NULL; dentry = dentry->brother) {
+        index++;
+    }
+    newfs_mark_blks(dir, index / dentry_per_blk, dir->blk_cnt, sizeof(struct newfs_dentry_d));
+}
+/**
+ * @brief inode已写回或被删除，将其从脏链表摘下
+ */
+void newfs_clean_inode(struct newfs_inode* inode) {
+    struct newfs_inode** cursor = &super.dirty_list;
+    if (!inode->dirty) {
+        return;
+    }
+    while (*cursor != inode) {
+        cursor = &(*cursor)->dirty_next;
+    }
+    *cursor = inode->dirty_next;
+    super.dirty_bytes -= inode->dirty_bytes;
+    inode->dirty       = FALSE;
+    if (inode->blk_dirty != NULL) {
+        memset(inode->blk_dirty, 0, inode->blk_cap);
+    }
+    inode->dirty_bytes = 0;
+    inode->dirty_next  = NULL;
+}
+/**
+ * @brief 写回脏链表上的inode，只写inode本身，不递归子目录
+ *
+ * @param all 为TRUE时全部写回，否则只写回驻留超过dirty_expire的，
+ *            脏数据超过dirty_bytes时同样全部写回
+ * @return int 写回的inode个数；某个inode出错时仍写回其余的，最后返回负值
+ */
+int newfs_writeback(int all) {
+    struct newfs_inode* inode;
+    struct newfs_inode* next;
+    uint64_t now = newfs_now_ms();
+    int cnt = 0, ret = 0;
+    all = all || super.dirty_bytes >= newfs_options.dirty_bytes;
+    for (inode = super.dirty_list; inode != NULL; inode = next) {
+        next = inode->dirty_next;
+        if (!all && now - inode->dirty_ms < (uint64_t)newfs_options.dirty_expire) {
+            continue;
+        }
+        if (newfs_write_inode(inode) != 0) {          /* 留在脏链表上，下次重试 */
+            ret = -EIO;
+            continue;
+        }
+        newfs_clean_inode(inode);
+        cnt++;
+    }
+    return ret < 0 ? ret : cnt;
+}
@@ -3,8 +3,8 @@ POINTS=0
 TOTAL_POINTS=0
 TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh)
 # mount.sh mkdir.sh touch.sh ls.sh remount.sh (read.sh write.sh cp.sh)
-ALL_TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh cp.sh)
-ALL_TEST_SCORES=(1 4 5 4 16 2 2)
+ALL_TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh cp.sh bigrw.sh indirect.sh nospc.sh bigls.sh)
+ALL_TEST_SCORES=(1 4 5 4 16 2 2 3 3 3 3)
 MNTPOINT='./mnt'
 PROJECT_NAME="newfs"
 
@@ -35,6 +35,10 @@ elif [[ "${LEVEL}" == "6" ]]; then
     echo "开始mount, mkdir, touch, ls, read&write, cp, umount测试"
     TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh cp.sh)
     sleep 1
+elif [[ "${LEVEL}" == "7" ]]; then
+    echo "开始大文件读写, 间接块格式, 磁盘写满, 大目录测试"
+    TEST_CASES=(bigrw.sh indirect.sh nospc.sh bigls.sh)
+    sleep 1
 else
     echo "未知测试参数"
     exit 1
@@ -95,8 +99,9 @@ function fail() {
 }
 
 # Utils
+# 额外参数原样传给文件系统, 如--indirect
 function mount_fuse() {
-    "$ROOT_PATH"/../build/"${PROJECT_NAME}" --device="$HOME"/ddriver "${MNTPOINT}"
+    "$ROOT_PATH"/../build/"${PROJECT_NAME}" --device="$HOME"/ddriver "$@" "${MNTPOINT}"
 }
 
 function check_mount() {
@@ -109,7 +114,7 @@ function check_mount() {
 
 function try_mount_or_fail() {
     if ! check_mount; then
-        mount_fuse
+        mount_fuse "$@"
         if ! check_mount; then
             fail "$TEST_CASE: mount的返回值为0, 但是没有挂载成功, 请仔细检查"
             exit 1
@@ -150,6 +155,67 @@ function touch_and_check () {
     fi
 }
 
+ERR_OK=0
+INODE_MAP_ERR=1
+DATA_MAP_ERR=2
+LAYOUT_FILE_ERR=3
+GOLDEN_LAYOUT_MISMATCH=4
+DATA_ERR=5
+
+# 按checkbm/下的$BM_RULES检查位图, 需在umount之后调用
+BM_RULES="golden.json"
+
+function check_bm() {
+    _PARAM=$1
+    _TEST_CASE=$2
+    ROOT_PARENT_PATH=$(cd $(dirname $ROOT_PATH); pwd)
+    python3 "$ROOT_PATH"/checkbm/checkbm.py -l "$ROOT_PARENT_PATH"/include/fs.layout -r "$ROOT_PARENT_PATH"/tests/checkbm/"$BM_RULES" > /dev/null
+    RET=$?
+    if (( RET == ERR_OK )); then
+        return 0
+    elif (( RET == INODE_MAP_ERR )); then
+        fail "$_TEST_CASE: Inode位图错误, 请使用checkbm.py和ddriver工具自行检查. 注: 在命令行输入ddriver -d并且安装HexEditor插件即可查看当前ddriver介质情况"
+    elif (( RET == DATA_MAP_ERR )); then
+        fail "$_TEST_CASE: 数据位图错误, 请使用checkbm.py和ddriver工具自行检查. 注: 在命令行输入ddriver -d并且安装HexEditor插件即可查看当前ddriver介质情况"
+        elif (( RET == DATA_ERR )); then
+        fail "$_TEST_CASE: 数据写回错误, 请检查数据是否正确写回到数据区的指定位置"
+    elif (( RET == LAYOUT_FILE_ERR )); then
+        fail "$_TEST_CASE: .layout文件有误, 请结合报错信息自行检查"
+    elif (( RET == GOLDEN_LAYOUT_MISMATCH )); then
+        fail "$_TEST_CASE: .layout文件和本次实验布局不符, 请结合报错信息自行检查"
+    fi
+    return 1
+}
+
+# 大文件读写: 将$BIG_GOLDEN拷贝到$1并读回比较, remount后再次比较
+function check_big_write () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if ! cp "$BIG_GOLDEN" "$_PARAM"; then
+        fail "$_TEST_CASE: 写入$(stat -c %s "$BIG_GOLDEN")字节到文件$_PARAM失败"
+        return 1
+    fi
+    if ! cmp -s "$BIG_GOLDEN" "$_PARAM"; then
+        fail "$_TEST_CASE: 写入$_PARAM成功, 但读回的内容不同"
+        return 1
+    fi
+    return 0
+}
+
+function check_big_read () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if [[ $(stat -c %s "$_PARAM") != $(stat -c %s "$BIG_GOLDEN") ]]; then
+        fail "$_TEST_CASE: remount后$_PARAM的大小不是$(stat -c %s "$BIG_GOLDEN")"
+        return 1
+    fi
+    if ! cmp -s "$BIG_GOLDEN" "$_PARAM"; then
+        fail "$_TEST_CASE: remount后读$_PARAM成功, 但内容不同"
+        return 1
+    fi
+    return 0
+}
+
 # Test
 function register_testcase() {
     for target_test_case in "${TEST_CASES[@]}"; do
@@ -0,0 +1,47 @@
+#!/bin/bash
+
+TEST_CASE="case 11 - large directory"
+
+# dir0下500个文件, 目录项占用多个块, 哈希表需多次扩容
+FILE_COUNT=500
+
+function check_ls_large () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    OUTPUT=$(ls "$_PARAM" | sort)
+    GOLDEN=$(seq -f "file%g" 0 $((FILE_COUNT - 1)) | sort)
+    if [[ "${OUTPUT}" != "${GOLDEN}" ]]; then
+        fail "$_TEST_CASE: ls $_PARAM的输出应为file0到file$((FILE_COUNT - 1))共${FILE_COUNT}项, 实际为$(echo "$OUTPUT" | wc -l)项"
+        return 1
+    fi
+    return 0
+}
+
+clean_mount
+clean_ddriver
+
+try_mount_or_fail
+
+mkdir_and_check "${MNTPOINT}"/dir0
+if ! touch $(seq -f "${MNTPOINT}/dir0/file%g" 0 $((FILE_COUNT - 1))); then
+    fail "$TEST_CASE: 在${MNTPOINT}/dir0下创建${FILE_COUNT}个文件失败"
+fi
+
+TEST_CASE="case 11.1 - ls ${MNTPOINT}/dir0"
+core_tester ls "${MNTPOINT}"/dir0 check_ls_large "$TEST_CASE"
+
+clean_mount
+sleep 1
+try_mount_or_fail
+
+TEST_CASE="case 11.2 - ls ${MNTPOINT}/dir0 after remount"
+core_tester ls "${MNTPOINT}"/dir0 check_ls_large "$TEST_CASE"
+
+clean_mount
+
+# root, dir0与500个文件, 根目录1块加dir0的72个目录项块; 4MB介质最多约600个inode
+TEST_CASE="case 11.3 - check bitmap"
+BM_RULES="golden-bigls.json"
+core_tester echo "$TEST_CASE" check_bm "$TEST_CASE"
+
+clean_ddriver
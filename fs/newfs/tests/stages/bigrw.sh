@@ -0,0 +1,33 @@
+#!/bin/bash
+
+TEST_CASE="case 8 - big file read/write"
+
+# 2MB随机数据, 远大于单次写回与预读的范围
+BIG_GOLDEN=$(mktemp)
+
+clean_mount
+clean_ddriver
+
+head -c $((2 * 1024 * 1024)) /dev/urandom > "$BIG_GOLDEN"
+
+try_mount_or_fail
+
+TEST_CASE="case 8.1 - write and read back ${MNTPOINT}/big"
+core_tester echo "${MNTPOINT}"/big check_big_write "$TEST_CASE"
+
+clean_mount
+sleep 1
+try_mount_or_fail
+
+TEST_CASE="case 8.2 - read ${MNTPOINT}/big after remount"
+core_tester echo "${MNTPOINT}"/big check_big_read "$TEST_CASE"
+
+clean_mount
+
+# root与big两个inode, 根目录1块加big的2048块
+TEST_CASE="case 8.3 - check bitmap"
+BM_RULES="golden-bigrw.json"
+core_tester echo "$TEST_CASE" check_bm "$TEST_CASE"
+
+rm -f "$BIG_GOLDEN"
+clean_ddriver
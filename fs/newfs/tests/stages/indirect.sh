@@ -0,0 +1,34 @@
+#!/bin/bash
+
+TEST_CASE="case 9 - indirect format"
+
+# 以--indirect格式化, 2MB的文件需要一级和二级间接块
+BIG_GOLDEN=$(mktemp)
+
+clean_mount
+clean_ddriver
+
+head -c $((2 * 1024 * 1024)) /dev/urandom > "$BIG_GOLDEN"
+
+try_mount_or_fail --indirect
+
+TEST_CASE="case 9.1 - write and read back ${MNTPOINT}/big with --indirect"
+core_tester echo "${MNTPOINT}"/big check_big_write "$TEST_CASE"
+
+clean_mount
+sleep 1
+# 格式记录在超级块中, remount时不必再指定--indirect
+try_mount_or_fail
+
+TEST_CASE="case 9.2 - read ${MNTPOINT}/big after remount"
+core_tester echo "${MNTPOINT}"/big check_big_read "$TEST_CASE"
+
+clean_mount
+
+# 比case 8.3多出9个间接块: 一级间接块, 二级间接块及其下的7个一级间接块
+TEST_CASE="case 9.3 - check bitmap"
+BM_RULES="golden-indirect.json"
+core_tester echo "$TEST_CASE" check_bm "$TEST_CASE"
+
+rm -f "$BIG_GOLDEN"
+clean_ddriver
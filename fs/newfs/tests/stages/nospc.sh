@@ -0,0 +1,62 @@
+#!/bin/bash
+
+TEST_CASE="case 10 - no space"
+
+# 默认4MB的介质写8MB, 写满时应返回ENOSPC而不是在umount时才丢数据
+FILL_COUNT=2048
+
+function check_nospc () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if ! LC_ALL=C dd if=/dev/zero of="${MNTPOINT}"/fill bs=4096 count="$FILL_COUNT" 2>&1 \
+        | grep -q "No space left on device"; then
+        fail "$_TEST_CASE: 写满${MNTPOINT}时没有返回ENOSPC"
+        return 1
+    fi
+    FILL_SIZE=$(stat -c %s "${MNTPOINT}"/fill)
+    if (( FILL_SIZE == 0 )) || ! cmp -s -n "$FILL_SIZE" "${MNTPOINT}"/fill /dev/zero; then
+        fail "$_TEST_CASE: 写满前已写入${MNTPOINT}/fill的${FILL_SIZE}字节内容不正确"
+        return 1
+    fi
+    return 0
+}
+
+function check_nospc_remount () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if [[ $(stat -c %s "${MNTPOINT}"/fill) != "${FILL_SIZE}" ]] \
+        || ! cmp -s -n "$FILL_SIZE" "${MNTPOINT}"/fill /dev/zero; then
+        fail "$_TEST_CASE: remount后${MNTPOINT}/fill与写满前写入的${FILL_SIZE}字节不同"
+        return 1
+    fi
+    if ! rm "${MNTPOINT}"/fill; then
+        fail "$_TEST_CASE: 删除${MNTPOINT}/fill失败"
+        return 1
+    fi
+    touch_and_check "${MNTPOINT}"/hello
+    return 0
+}
+
+clean_mount
+clean_ddriver
+
+try_mount_or_fail
+
+TEST_CASE="case 10.1 - fill ${MNTPOINT} until ENOSPC"
+core_tester echo "$TEST_CASE" check_nospc "$TEST_CASE"
+
+clean_mount
+sleep 1
+try_mount_or_fail
+
+TEST_CASE="case 10.2 - remount and remove ${MNTPOINT}/fill"
+core_tester echo "$TEST_CASE" check_nospc_remount "$TEST_CASE"
+
+clean_mount
+
+# 删除fill后只剩root与hello, 写满时分配的块与预留都应已释放, 与case 5.3相同
+TEST_CASE="case 10.3 - check bitmap"
+BM_RULES="golden.json"
+core_tester echo "$TEST_CASE" check_bm "$TEST_CASE"
+
+clean_ddriver
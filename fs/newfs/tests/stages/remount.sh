@@ -56,35 +56,6 @@ function check_ls_remount () {
     return 0
 }
 
-ERR_OK=0
-INODE_MAP_ERR=1
-DATA_MAP_ERR=2
-LAYOUT_FILE_ERR=3
-GOLDEN_LAYOUT_MISMATCH=4
-DATA_ERR=5
-
-function check_bm() {
-    _PARAM=$1
-    _TEST_CASE=$2
-    ROOT_PARENT_PATH=$(cd $(dirname $ROOT_PATH); pwd)
-    python3 "$ROOT_PATH"/checkbm/checkbm.py -l "$ROOT_PARENT_PATH"/include/fs.layout -r "$ROOT_PARENT_PATH"/tests/checkbm/golden.json > /dev/null
-    RET=$?
-    if (( RET == ERR_OK )); then
-        return 0
-    elif (( RET == INODE_MAP_ERR )); then
-        fail "$_TEST_CASE: Inode位图错误, 请使用checkbm.py和ddriver工具自行检查. 注: 在命令行输入ddriver -d并且安装HexEditor插件即可查看当前ddriver介质情况"
-    elif (( RET == DATA_MAP_ERR )); then
-        fail "$_TEST_CASE: 数据位图错误, 请使用checkbm.py和ddriver工具自行检查. 注: 在命令行输入ddriver -d并且安装HexEditor插件即可查看当前ddriver介质情况"
-        elif (( RET == DATA_ERR )); then
-        fail "$_TEST_CASE: 数据写回错误, 请检查数据是否正确写回到数据区的指定位置"
-    elif (( RET == LAYOUT_FILE_ERR )); then
-        fail "$_TEST_CASE: .layout文件有误, 请结合报错信息自行检查"
-    elif (( RET == GOLDEN_LAYOUT_MISMATCH )); then
-        fail "$_TEST_CASE: .layout文件和本次实验布局不符, 请结合报错信息自行检查"
-    fi
-    return 1
-}
-
 clean_mount
 clean_ddriver
 
@@ -118,6 +89,7 @@ sleep 1
 
 
 TEST_CASE="case 5.3 - check bitmap"
+BM_RULES="golden.json"
 core_tester ls "${MNTPOINT}" check_bm "$TEST_CASE" 12
 
 clean_mount
@@ -39,10 +39,11 @@ else
     echo "----测试阶段4：增加 umount 及 remount 测试"
     echo "----测试阶段5：增加 read 及 write 测试"
     echo "----测试阶段6：增加 copy 测试"
-    read -r -p "按照你的进度输入测试等级[数字1-6]: " LEVEL 
-    if [[ "${LEVEL}" -ge "1" ]] && [[ "${LEVEL}" -le "6" ]]; then
+    echo "----测试阶段7：大文件读写, 间接块格式, 磁盘写满, 大目录测试"
+    read -r -p "按照你的进度输入测试等级[数字1-7]: " LEVEL 
+    if [[ "${LEVEL}" -ge "1" ]] && [[ "${LEVEL}" -le "7" ]]; then
         ./main.sh "${LEVEL}"
     else
-        echo "!! Wrong Test Level! Please input 1 to 6 !!"
+        echo "!! Wrong Test Level! Please input 1 to 7 !!"
     fi
 fi
\ No newline at end of file
@@ -50,15 +50,11 @@ int sfs_driver_read(int offset, uint8_t *out_content, int size) {
     int      bias           = offset - offset_aligned;
     int      size_aligned   = SFS_ROUND_UP((size + bias), SFS_IO_SZ());
     uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
-    uint8_t* cur            = temp_content;
     // lseek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
-    {
-        // read(SFS_DRIVER(), cur, SFS_IO_SZ());
-        ddriver_read(SFS_DRIVER(), cur, SFS_IO_SZ());
-        cur          += SFS_IO_SZ();
-        size_aligned -= SFS_IO_SZ();   
+    if (ddriver_pread(SFS_DRIVER(), (char *)temp_content, size_aligned, 
+                      offset_aligned) != size_aligned) {
+        free(temp_content);
+        return -SFS_ERROR_IO;
     }
     memcpy(out_content, temp_content + bias, size);
     free(temp_content);
@@ -77,18 +73,14 @@ int sfs_driver_write(int offset, uint8_t *in_content, int size) {
     int      bias           = offset - offset_aligned;
     int      size_aligned   = SFS_ROUND_UP((size + bias), SFS_IO_SZ());
     uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
-    uint8_t* cur            = temp_content;
     sfs_driver_read(offset_aligned, temp_content, size_aligned);
     memcpy(temp_content + bias, in_content, size);
     
     // lseek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
-    {
-        // write(SFS_DRIVER(), cur, SFS_IO_SZ());
-        ddriver_write(SFS_DRIVER(), cur, SFS_IO_SZ());
-        cur          += SFS_IO_SZ();
-        size_aligned -= SFS_IO_SZ();   
+    if (ddriver_pwrite(SFS_DRIVER(), (char *)temp_content, size_aligned, 
+                       offset_aligned) != size_aligned) {
+        free(temp_content);
+        return -SFS_ERROR_IO;
     }
 
     free(temp_content);